@@ -0,0 +1,290 @@
+/**
+ * Host-side benchmark for the kernel heap (src/c/memory/memory.c).
+ *
+ * memory.c is compiled unmodified for 32-bit Linux. The Makefile renames
+ * malloc/free/calloc/realloc/aligned_alloc to k* on the command line, so in
+ * this file (and in memory.c) those names mean the kernel allocator while
+ * libc keeps its own. The heap lives in an mmap'd region that plays the
+ * role of physical memory, pmm_claim_frames/pmm_free_frames move its end.
+ * KERNEL_VIRTUAL_BASE is 0 here, so heap addresses are their own "physical" ones.
+ * The kernel's kprintf (src/c/libk/printf.c) is linked in for the profile
+ * report, its screen and serial output both end up on stdout.
+ *
+ * Every trace is generated (or read) into an array of operations first, then
+ * replayed twice: once timed, once with fragmentation and block count sampled
+ * after every operation.
+ *
+ * Usage: bench_alloc [trace-file]
+ * A trace file has one operation per line, slots are small integers:
+ *   a <slot> <size>   allocate size bytes into slot
+ *   r <slot> <size>   realloc slot to size bytes
+ *   f <slot>          free slot
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "memory/memory.h"
+#include "memory/pmm.h"
+
+#define BENCH_REGION_SIZE (256u << 20)  // Address space the heap may grow into
+#define BENCH_INITIAL_HEAP 0x80000      // Same start size as the kernel heap
+#define BENCH_MAX_OPS 1000000
+#define BENCH_MAX_SLOTS 4096
+
+enum { OP_ALLOC, OP_REALLOC, OP_FREE };
+
+typedef struct {
+    u8 type;
+    u16 slot;
+    u32 size;
+} bench_op_t;
+
+typedef struct {
+    u32 peak_heap;
+    u32 peak_fragmentation;
+    u32 peak_blocks;
+    u32 final_blocks;
+    u32 failures;
+} bench_result_t;
+
+static bench_op_t ops[BENCH_MAX_OPS];
+static u32 op_count;
+static void* slots[BENCH_MAX_SLOTS];
+
+static u8* region;
+static u32 region_end;
+static u32 rng_state = 0x12345678;
+
+// Kernel symbols memory.c links against
+
+bool pmm_claim_frames(u32 address, u32 count) {
+    if (address != region_end || address + count * PMM_FRAME_SIZE > (u32)region + BENCH_REGION_SIZE) {
+        return false;
+    }
+    region_end += count * PMM_FRAME_SIZE;
+    return true;
+}
+
+void pmm_free_frames(u32 address, u32 count) {
+    if (address + count * PMM_FRAME_SIZE == region_end) {
+        region_end = address;
+    }
+}
+
+void vga_write(const char* text, u32 length, __attribute__((unused)) u8 fg, __attribute__((unused)) u8 bg) {
+    fwrite(text, 1, length, stdout);
+}
+void serial_write(const char* text, u32 length) { fwrite(text, 1, length, stdout); }
+
+// Trace generation
+
+static u32 rng() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void emit(u8 type, u32 slot, u32 size) {
+    if (op_count < BENCH_MAX_OPS) {
+        ops[op_count].type = type;
+        ops[op_count].slot = slot;
+        ops[op_count].size = size;
+        op_count++;
+    }
+}
+
+// Mostly small objects, some medium and a few large ones, freed in random order
+static void generate_random() {
+    static bool live[BENCH_MAX_SLOTS];
+    memset(live, 0, sizeof(live));
+    for (u32 i = 0; i < 300000; i++) {
+        u32 slot = rng() % 2048;
+        if (live[slot]) {
+            emit(OP_FREE, slot, 0);
+            live[slot] = false;
+            continue;
+        }
+        u32 kind = rng() % 100;
+        u32 size = kind < 75 ? 8 + rng() % 120 : kind < 95 ? 128 + rng() % 1920 : 2048 + rng() % 30720;
+        emit(OP_ALLOC, slot, size);
+        live[slot] = true;
+    }
+    for (u32 slot = 0; slot < BENCH_MAX_SLOTS; slot++) {
+        if (live[slot]) {
+            emit(OP_FREE, slot, 0);
+        }
+    }
+}
+
+// Typing into a document: the text buffer grows by realloc, every key
+// press allocates and frees a line buffer, saves copy the whole text
+static void generate_editor() {
+    const u32 document = 0, line = 1, copy = 2;
+    for (u32 session = 0; session < 50; session++) {
+        u32 length = 64;
+        emit(OP_ALLOC, document, length);
+        for (u32 key = 0; key < 2000; key++) {
+            emit(OP_ALLOC, line, 80);
+            length += 1 + rng() % 8;
+            emit(OP_REALLOC, document, length);
+            emit(OP_FREE, line, 0);
+            if (key % 250 == 249) {
+                emit(OP_ALLOC, copy, length);
+                emit(OP_FREE, copy, 0);
+            }
+        }
+        emit(OP_FREE, document, 0);
+    }
+}
+
+// Bursts of file creation with content written in steps, then deleting
+// them all again in random order
+static void generate_files() {
+    const u32 files = 64;
+    static u32 order[64];
+    for (u32 storm = 0; storm < 500; storm++) {
+        for (u32 i = 0; i < files; i++) {
+            emit(OP_ALLOC, i * 2, 2048);                 // file record
+            u32 length = 16 + rng() % 256;
+            emit(OP_ALLOC, i * 2 + 1, length);           // content
+            for (u32 write = rng() % 4; write > 0; write--) {
+                length += rng() % 512;
+                emit(OP_REALLOC, i * 2 + 1, length);
+            }
+            order[i] = i;
+        }
+        for (u32 i = files - 1; i > 0; i--) {
+            u32 j = rng() % (i + 1);
+            u32 temp = order[i];
+            order[i] = order[j];
+            order[j] = temp;
+        }
+        for (u32 i = 0; i < files; i++) {
+            emit(OP_FREE, order[i] * 2 + 1, 0);
+            emit(OP_FREE, order[i] * 2, 0);
+        }
+    }
+}
+
+static bool load_trace(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    char type;
+    u32 slot, size;
+    while (fscanf(file, " %c %u", &type, &slot) == 2) {
+        size = 0;
+        if ((type == 'a' || type == 'r') && fscanf(file, " %u", &size) != 1) {
+            break;
+        }
+        if (slot >= BENCH_MAX_SLOTS) {
+            continue;
+        }
+        emit(type == 'a' ? OP_ALLOC : type == 'r' ? OP_REALLOC : OP_FREE, slot, size);
+    }
+    fclose(file);
+    return true;
+}
+
+// Replay
+
+static void reset_heap() {
+    region_end = (u32)region + BENCH_INITIAL_HEAP;
+    memory_init((u32)region, BENCH_INITIAL_HEAP);
+    memset(slots, 0, sizeof(slots));
+}
+
+static void replay_op(bench_op_t* op) {
+    void** slot = &slots[op->slot];
+    switch (op->type) {
+        case OP_ALLOC:
+            free(*slot); // Traces may reuse a slot without freeing it
+            *slot = malloc(op->size);
+            break;
+        case OP_REALLOC: {
+            void* resized = realloc(*slot, op->size);
+            if (resized) {
+                *slot = resized;
+            }
+            break;
+        }
+        case OP_FREE:
+            free(*slot);
+            *slot = 0;
+            break;
+    }
+}
+
+static double replay_timed() {
+    reset_heap();
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (u32 i = 0; i < op_count; i++) {
+        replay_op(&ops[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    return ns / op_count;
+}
+
+static bench_result_t replay_sampled() {
+    bench_result_t result = {0, 0, 0, 0, 0};
+    reset_heap();
+    for (u32 i = 0; i < op_count; i++) {
+        replay_op(&ops[i]);
+
+        u32 total, blocks;
+        memory_get_stats(&total, 0, 0, &blocks);
+        u32 fragmentation = memory_get_fragmentation();
+        if (total > result.peak_heap) result.peak_heap = total;
+        if (fragmentation > result.peak_fragmentation) result.peak_fragmentation = fragmentation;
+        if (blocks > result.peak_blocks) result.peak_blocks = blocks;
+    }
+    memory_get_stats(0, 0, 0, &result.final_blocks);
+    result.failures = memory_get_profile()->failures;
+    return result;
+}
+
+static void run(const char* name) {
+    double ns_per_op = replay_timed();
+    bench_result_t result = replay_sampled();
+    printf("%-8s %8u %9.1f %10u KiB %8u%% %8u %8u %8u\n", name, op_count, ns_per_op,
+           result.peak_heap / 1024, result.peak_fragmentation, result.peak_blocks,
+           result.final_blocks, result.failures);
+}
+
+int main(int argc, char** argv) {
+    region = mmap(0, BENCH_REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        fputs("Failed to map the heap region\n", stderr);
+        return 1;
+    }
+
+    printf("%-8s %8s %9s %14s %9s %8s %8s %8s\n", "trace", "ops", "ns/op", "peak heap", "peak frag",
+           "peak blk", "end blk", "failed");
+
+    if (argc > 1) {
+        if (!load_trace(argv[1])) {
+            fprintf(stderr, "Failed to read trace %s\n", argv[1]);
+            return 1;
+        }
+        run("file");
+    } else {
+        generate_random();
+        run("random");
+        op_count = 0;
+        generate_editor();
+        run("editor");
+        op_count = 0;
+        generate_files();
+        run("files");
+    }
+
+    puts("\nAllocation profile of the last replay:");
+    memory_print_profile(true);
+    return 0;
+}
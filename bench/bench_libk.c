@@ -0,0 +1,137 @@
+/**
+ * Host-side benchmark for the libk memory primitives (src/c/libk/mem.c).
+ *
+ * mem.c is compiled unmodified for 32-bit Linux. The Makefile renames
+ * memcpy/memmove/memset/memcmp to k* on the command line, so libc keeps its
+ * own. Each operation is timed per size bucket three ways: a byte-at-a-time
+ * loop like the ones libk replaced, libk with rep movsd/stosd (no SSE2) and
+ * libk with SSE2. kernel_fpu_begin/end are free here; in the kernel they add
+ * a few CR0 writes, which LIBK_SSE2_MIN_SIZE accounts for. cpuid reports no
+ * ERMSB here, so the sse2 row uses SSE2 for every operation; on CPUs with
+ * ERMSB the kernel keeps rep movs/stos for memcpy and memset.
+ *
+ * Usage: bench_libk
+ * Prints MiB/s for every operation, variant and size.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "libk/mem.h"
+#include "kernel/fpu.h"
+
+#define BENCH_BUFFER_SIZE (1u << 20)
+#define BENCH_BYTES_PER_RUN (64u << 20)  // Bytes processed per measurement
+
+enum { VARIANT_BYTES, VARIANT_REP, VARIANT_SSE2, VARIANT_COUNT };
+static const char* variant_names[VARIANT_COUNT] = {"bytes", "rep", "sse2"};
+
+static const u32 sizes[] = {16, 64, 256, 1024, 4096, 16384, 65536, BENCH_BUFFER_SIZE / 2};
+
+static u8* source;
+static u8* destination;
+static bool sse2_available;
+static volatile int sink;
+
+// Kernel symbols mem.c links against
+
+bool fpu_has_feature(__attribute__((unused)) u32 feature) { return sse2_available; }
+void read_cpuid(__attribute__((unused)) u32 leaf, u32* eax, u32* ebx, u32* ecx, u32* edx) {
+    *eax = *ebx = *ecx = *edx = 0;
+}
+void kernel_fpu_begin() {}
+void kernel_fpu_end() {}
+
+// The loops libk replaced (noipa: gcc must not see they have no side effects)
+
+__attribute__((noipa)) static void bytes_copy(u8* to, const u8* from, u32 count) {
+    for (u32 i = 0; i < count; i++) to[i] = from[i];
+}
+
+__attribute__((noipa)) static void bytes_move(u8* to, const u8* from, u32 count) {
+    for (u32 i = count; i > 0; i--) to[i - 1] = from[i - 1];
+}
+
+__attribute__((noipa)) static void bytes_set(u8* to, u8 value, u32 count) {
+    for (u32 i = 0; i < count; i++) to[i] = value;
+}
+
+__attribute__((noipa)) static int bytes_compare(const u8* a, const u8* b, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        if (a[i] != b[i]) return a[i] - b[i];
+    }
+    return 0;
+}
+
+// One operation on size bytes. The move shifts up by one byte, the overlapping case of an editor insert.
+typedef void (*bench_op_t)(int variant, u32 size);
+
+static void op_memcpy(int variant, u32 size) {
+    if (variant == VARIANT_BYTES) bytes_copy(destination, source, size);
+    else memcpy(destination, source, size);
+}
+
+static void op_memmove(int variant, u32 size) {
+    if (variant == VARIANT_BYTES) bytes_move(destination + 1, destination, size);
+    else memmove(destination + 1, destination, size);
+}
+
+static void op_memset(int variant, u32 size) {
+    if (variant == VARIANT_BYTES) bytes_set(destination, 0x5A, size);
+    else memset(destination, 0x5A, size);
+}
+
+// Compares equal buffers, the worst case
+static void op_memcmp(int variant, u32 size) {
+    sink += variant == VARIANT_BYTES ? bytes_compare(destination, source, size) : memcmp(destination, source, size);
+}
+
+static double run(bench_op_t op, int variant, u32 size) {
+    sse2_available = variant == VARIANT_SSE2;
+    libk_init();
+
+    u32 rounds = BENCH_BYTES_PER_RUN / size;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (u32 i = 0; i < rounds; i++) {
+        op(variant, size);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return (double)rounds * size / seconds / (1 << 20);
+}
+
+static void bench(const char* name, bench_op_t op) {
+    printf("\n%-8s", name);
+    for (u32 i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        printf(" %9u", sizes[i]);
+    }
+    putchar('\n');
+    for (int variant = 0; variant < VARIANT_COUNT; variant++) {
+        printf("%-8s", variant_names[variant]);
+        for (u32 i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            printf(" %9.0f", run(op, variant, sizes[i]));
+        }
+        putchar('\n');
+    }
+}
+
+int main() {
+    source = aligned_alloc(64, BENCH_BUFFER_SIZE);
+    destination = aligned_alloc(64, BENCH_BUFFER_SIZE + 64);
+    if (!source || !destination) {
+        fputs("Out of memory\n", stderr);
+        return 1;
+    }
+    for (u32 i = 0; i < BENCH_BUFFER_SIZE; i++) {
+        source[i] = destination[i] = (u8)i;
+    }
+
+    printf("Throughput in MiB/s per size in bytes (SSE2 from %u bytes)\n", LIBK_SSE2_MIN_SIZE);
+    bench("memcpy", op_memcpy);
+    bench("memmove", op_memmove);
+    bench("memset", op_memset);
+    memcpy(destination, source, BENCH_BUFFER_SIZE);
+    bench("memcmp", op_memcmp);
+    return 0;
+}
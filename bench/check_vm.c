@@ -0,0 +1,139 @@
+/**
+ * Host-side check of the kernel's virtual range allocator (src/c/memory/vm.c).
+ *
+ * vm.c is compiled unmodified for 32-bit Linux. Nothing is ever committed, so
+ * the paging and frame allocator calls it makes are stubbed out below: there
+ * are no page tables and every lookup finds an empty entry.
+ *
+ * A fixed script first reserves regions around a gap that holds the request
+ * only if the region behind it loses its guard page, so it must not be used.
+ * Then a long random mix of vm_reserve and vm_release runs, and after every
+ * step the region table must be sorted, inside
+ * [PAGING_KERNEL_VM_START, PAGING_KERNEL_VM_END) and have an unreserved page
+ * in front of each region. Any violation is printed and fails the run.
+ *
+ * Usage: check_vm [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "memory/vm.h"
+#include "memory/paging.h"
+#include "memory/pmm.h"
+
+#define CHECK_STEPS 200000
+
+// Stubs for what vm.c needs from paging.c and pmm.c
+u32* paging_get_entry(u32 virtual_address, bool create) {
+    (void)virtual_address; (void)create;
+    return 0;
+}
+
+bool paging_map_page(u32 virtual_address, u32 physical_address, u32 flags) {
+    (void)virtual_address; (void)physical_address; (void)flags;
+    return true;
+}
+
+u32 paging_unmap_page(u32 virtual_address) {
+    (void)virtual_address;
+    return 0;
+}
+
+u32 pmm_alloc_frame() {
+    return 0;
+}
+
+void pmm_free_frame(u32 address) {
+    (void)address;
+}
+
+static u32 rng_state = 1;
+
+static u32 rng() {
+    rng_state = rng_state * 1103515245u + 12345u;
+    return rng_state >> 8;
+}
+
+// Checks the region table, prints what is wrong and returns false on a violation
+static bool check_regions(const char* step) {
+    const vm_t* vm = vm_get_info();
+    u32 free_from = PAGING_KERNEL_VM_START; // First address the next region's guard page may use
+    for (u32 i = 0; i < vm->region_count; i++) {
+        const vm_region_t* region = &vm->regions[i];
+        if (region->size == 0 || region->start < free_from || region->start - free_from < PAGE_SIZE ||
+            region->start >= PAGING_KERNEL_VM_END || PAGING_KERNEL_VM_END - region->start < region->size) {
+            printf("%s: region %u [%08x, %08x) overlaps or has no guard page (free from %08x)\n",
+                   step, i, region->start, region->start + region->size, free_from);
+            return false;
+        }
+        free_from = region->start + region->size;
+    }
+    return true;
+}
+
+// A gap between two regions that holds a request only without the guard page
+// of the region behind it
+static bool check_tight_gap() {
+    u32 a = vm_reserve(PAGE_SIZE);
+    u32 hole = vm_reserve(3 * PAGE_SIZE);
+    u32 b = vm_reserve(PAGE_SIZE);
+    if (!a || !hole || !b || !check_regions("setup")) {
+        return false;
+    }
+
+    // Releasing hole frees four pages before b, one of them must stay b's guard page
+    vm_release(hole);
+    u32 tight = vm_reserve(4 * PAGE_SIZE);
+    if (tight == hole || !check_regions("tight gap")) {
+        printf("tight gap: got %08x, the gap starts at %08x\n", tight, hole);
+        return false;
+    }
+    u32 fit = vm_reserve(3 * PAGE_SIZE);
+    if (fit != hole || !check_regions("fitting gap")) {
+        printf("fitting gap: got %08x, expected %08x\n", fit, hole);
+        return false;
+    }
+
+    vm_release(a); vm_release(b); vm_release(tight); vm_release(fit);
+    return vm_get_info()->region_count == 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        rng_state = (u32)strtoul(argv[1], 0, 0);
+    }
+    vm_init();
+
+    if (!check_tight_gap()) {
+        printf("FAIL tight gap\n");
+        return 1;
+    }
+
+    u32 starts[VM_MAX_REGIONS];
+    u32 count = 0, reserved = 0, released = 0, refused = 0;
+    for (u32 step = 0; step < CHECK_STEPS; step++) {
+        if (count > 0 && (count == VM_MAX_REGIONS || rng() % 3 == 0)) {
+            u32 pick = rng() % count;
+            vm_release(starts[pick]);
+            starts[pick] = starts[--count];
+            released++;
+        } else {
+            // Mostly a few pages, sometimes large enough to run out of range
+            u32 size = rng() % 4 ? (rng() % 16 + 1) * PAGE_SIZE : (rng() % 1024 + 1) << 20;
+            u32 start = vm_reserve(size);
+            if (start) {
+                starts[count++] = start;
+                reserved++;
+            } else {
+                refused++;
+            }
+        }
+        if (!check_regions("random step") || vm_get_info()->region_count != count) {
+            printf("FAIL at step %u\n", step);
+            return 1;
+        }
+    }
+
+    printf("ok: %u reserved, %u released, %u refused, %u regions left\n", reserved, released, refused, count);
+    return 0;
+}
@@ -5,10 +5,33 @@
 ; switch to the protected mode. If boot is successful then we must have
 ; 0x2BADB002 value set in the eax. Grub will call whatever entrypoint we
 ; specify in the ELF file. We configure linker to make this "start" such entrypoint.
+;
+; The kernel is linked to run at KERNEL_VIRTUAL_BASE + its physical address
+; (see link.ld), but grub jumps here with paging off. Until paging is on,
+; kernel symbols must therefore be accessed through their physical addresses.
+KERNEL_VIRTUAL_BASE     equ 0xC0000000 ; Same as in kernel.h and link.ld
+KERNEL_PAGE_INDEX       equ KERNEL_VIRTUAL_BASE >> 22
+DIRECT_MAP_PAGES        equ 192        ; 768 MiB in 4 MiB pages, see KERNEL_DIRECT_MAP_SIZE
+
+PDE_PRESENT             equ 1 << 0
+PDE_WRITABLE            equ 1 << 1
+PDE_LARGE               equ 1 << 7     ; 4 MiB page (needs CR4.PSE)
+PDE_GLOBAL              equ 1 << 8     ; Kept in the TLB across CR3 reloads (needs CR4.PGE)
+CR4_PSE                 equ 1 << 4
+CR4_PGE                 equ 1 << 7
+CR0_PG                  equ 1 << 31
+CPUID_EDX_PGE           equ 1 << 13
+
+; Grub jumps to the physical address of start
+global start_physical
+start_physical equ start - KERNEL_VIRTUAL_BASE
+
 global start
 start:
-    mov esp, stack_top
-    jmp entry_kernel
+    mov esp, stack_top - KERNEL_VIRTUAL_BASE
+    call run_checks
+    call enable_fpu
+    jmp enable_paging
 
 ; Multiboot header must be 4bytes aligned as per specification
 ; otherwise it might not be spotted by grub.
@@ -37,14 +60,67 @@ multiboot:
     dd 0
     dd 0
 
+; Turns paging on with boot_page_directory. Keeps eax and ebx (boot information).
+enable_paging:
+    mov ecx, boot_page_directory - KERNEL_VIRTUAL_BASE
+    mov cr3, ecx
+
+    mov ecx, cr4
+    or ecx, CR4_PSE
+    mov cr4, ecx
+
+    ; Global pages are optional, without them the G bit is ignored
+    push eax
+    push ebx
+    mov eax, 1
+    cpuid
+    pop ebx
+    pop eax
+    test edx, CPUID_EDX_PGE
+    jz .no_global_pages
+    mov ecx, cr4
+    or ecx, CR4_PGE
+    mov cr4, ecx
+.no_global_pages:
+
+    mov ecx, cr0
+    or ecx, CR0_PG
+    mov cr0, ecx
+
+    ; Still running at the physical address through the identity mapping,
+    ; an absolute jump moves execution to the higher half
+    lea ecx, [entry_kernel]
+    jmp ecx
+
 entry_kernel:
-    call run_checks
+    mov esp, stack_top
+    ; Grub leaves the physical address of the multiboot information
+    ; structure in ebx, pass it through the direct map as the first argument to kernel_entry.
+    add ebx, KERNEL_VIRTUAL_BASE
+    push ebx
     extern kernel_entry
     call kernel_entry
     jmp $
 
 %include "src/asm/checks.asm"
 
+SECTION .data align=4096
+; Page directory used from boot on (paging.c keeps using it):
+; - the first 4 MiB identity mapped, only until entry_kernel runs (paging_init drops it)
+; - the direct map: physical [0, 768 MiB) at KERNEL_VIRTUAL_BASE in global 4 MiB pages,
+;   which covers the kernel image, its data and the memory the frame allocator hands out
+; - the rest is left for 4 KiB page tables, see paging_map_page
+global boot_page_directory
+boot_page_directory:
+    dd PDE_PRESENT | PDE_WRITABLE | PDE_LARGE
+    times (KERNEL_PAGE_INDEX - 1) dd 0
+%assign page 0
+%rep DIRECT_MAP_PAGES
+    dd (page << 22) | PDE_PRESENT | PDE_WRITABLE | PDE_LARGE | PDE_GLOBAL
+%assign page page + 1
+%endrep
+    times (1024 - KERNEL_PAGE_INDEX - DIRECT_MAP_PAGES) dd 0
+
 SECTION .bss
     resb 8192 ; Reserves 8kb of memory in BSS section for kernel stack.
 stack_top:
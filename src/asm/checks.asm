@@ -1,8 +1,14 @@
 ; Error codes:
 ; M - indicates absence of expected multiboot value in aex.
+; P - indicates that the CPU has no 4 MiB pages (PSE).
+; F - indicates that the CPU has no x87 FPU.
+;
+; Checks run before paging is enabled, so they must not touch kernel data.
 
 run_checks:
     call check_multiboot
+    call check_pse
+    call check_fpu
     ret
 
 ; Spec - https://www.gnu.org/software/grub/manual/multiboot/multiboot.html
@@ -16,6 +22,79 @@ error_multiboot:
     mov al, "M"
     jmp print_error_and_halt
 
+; The boot page directory maps the kernel with 4 MiB pages.
+; Keeps eax and ebx, grub passes the magic value and the boot information in them.
+check_pse:
+    push eax
+    push ebx
+    mov eax, 1
+    cpuid
+    pop ebx
+    pop eax
+    test edx, 1 << 3 ; PSE
+    jz error_pse
+    ret
+
+error_pse:
+    mov al, "P"
+    jmp print_error_and_halt
+
+; Keeps eax and ebx like check_pse.
+check_fpu:
+    push eax
+    push ebx
+    mov eax, 1
+    cpuid
+    pop ebx
+    pop eax
+    test edx, 1 << 0 ; FPU
+    jz error_fpu
+    ret
+
+error_fpu:
+    mov al, "F"
+    jmp print_error_and_halt
+
+; Boot stage after the checks: turns on the x87 FPU and, if the CPU has them,
+; SSE and FXSAVE/FXRSTOR (SSE2 and SSE4.2 need nothing more). CR0.TS is left
+; set, so an FPU or SSE instruction outside kernel_fpu_begin/end traps (#NM)
+; instead of silently using registers nobody saves, see fpu.c.
+; Keeps eax and ebx.
+CR0_MP                  equ 1 << 1     ; wait/fwait trap along with TS
+CR0_EM                  equ 1 << 2     ; FPU emulation, must be off for SSE
+CR0_TS                  equ 1 << 3
+CR0_NE                  equ 1 << 5     ; Native FPU error reporting
+CR4_OSFXSR              equ 1 << 9
+CR4_OSXMMEXCPT          equ 1 << 10
+CPUID_EDX_FXSR          equ 1 << 24
+CPUID_EDX_SSE           equ 1 << 25
+
+enable_fpu:
+    push eax
+    push ebx
+    mov eax, cr0
+    and eax, ~CR0_EM
+    or eax, CR0_MP | CR0_NE
+    mov cr0, eax
+    fninit
+
+    mov eax, 1
+    cpuid
+    and edx, CPUID_EDX_FXSR | CPUID_EDX_SSE
+    cmp edx, CPUID_EDX_FXSR | CPUID_EDX_SSE
+    jne .no_sse
+    mov eax, cr4
+    or eax, CR4_OSFXSR | CR4_OSXMMEXCPT
+    mov cr4, eax
+.no_sse:
+
+    mov eax, cr0
+    or eax, CR0_TS
+    mov cr0, eax
+    pop ebx
+    pop eax
+    ret
+
 ; Print an error code that is stored in al.
 ; The error code can be passed using nasm ASCII covertion,
 ; like mov al, "X".
@@ -14,90 +14,136 @@ global irq12
 global irq13
 global irq14
 global irq15
+global irq_bench_legacy
+global irq_bench_lean
+
+; Interrupt gates clear IF on the way in, so the stubs need no cli. Each
+; pushes its vector and jumps to a common stub, which leaves the vector
+; where the CPU frame starts: [esp] vector, [esp+4] eip, [esp+8] cs.
 
 irq0:
-    cli
     push byte 32
     jmp irq_common_stub
 
 irq1:
-    cli
     push byte 33
     jmp irq_common_stub
 
 irq2:
-    cli
     push byte 34
     jmp irq_common_stub
 
 irq3:
-    cli
     push byte 35
     jmp irq_common_stub
 
 irq4:
-    cli
     push byte 36
     jmp irq_common_stub
 
 irq5:
-    cli
     push byte 37
     jmp irq_common_stub
 
 irq6:
-    cli
     push byte 38
     jmp irq_common_stub
 
 irq7:
-    cli
     push byte 39
     jmp irq_common_stub
 
 irq8:
-    cli
     push byte 40
     jmp irq_common_stub
 
 irq9:
-    cli
     push byte 41
     jmp irq_common_stub
 
 irq10:
-    cli
     push byte 42
     jmp irq_common_stub
 
 irq11:
-    cli
     push byte 43
     jmp irq_common_stub
 
 irq12:
-    cli
     push byte 44
     jmp irq_common_stub
 
 irq13:
-    cli
     push byte 45
     jmp irq_common_stub
 
 irq14:
-    cli
     push byte 46
     jmp irq_common_stub
 
 irq15:
-    cli
     push byte 47
     jmp irq_common_stub
 
 extern kernel_interrupt_handler
 
-irq_common_stub:
+; The common part of an entry stub: saves the registers C code may clobber
+; (eax, ecx, edx, the rest are preserved by the callee), calls %2 directly
+; with the vector as its argument and returns from the interrupt. Data
+; segments are only reloaded when the interrupted code ran with a CS of
+; another privilege level, as the kernel's own are loaded already otherwise.
+%macro IRQ_COMMON_STUB 2
+%1:
+    push eax
+    push ecx
+    push edx
+    test byte [esp + 20], 3 ; RPL of the interrupted cs
+    jnz %%other_segments
+    push dword [esp + 12]
+    call %2
+    add esp, 4
+    pop edx
+    pop ecx
+    pop eax
+    add esp, 4
+    iret
+%%other_segments:
+    push ds
+    push es
+    push fs
+    push gs
+    mov ax, 0x10 ; kernel data segment
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    push dword [esp + 28]
+    call %2
+    add esp, 4
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    pop edx
+    pop ecx
+    pop eax
+    add esp, 4
+    iret
+%endmacro
+
+IRQ_COMMON_STUB irq_common_stub, kernel_interrupt_handler
+
+; Stubs for benchmark_interrupt_entry, which raises them with int to time
+; a round trip through an entry stub to a handler that does nothing. The
+; legacy one is the entry path the IRQs had before: cli, all registers and
+; segments saved and reloaded and an indirect call.
+
+irq_bench_null:
+    ret
+
+irq_bench_legacy:
+    cli
+    push byte 0
     pusha
     push ds
     push es
@@ -110,7 +156,7 @@ irq_common_stub:
     mov gs, ax
     mov eax, esp
     push eax
-    mov eax, kernel_interrupt_handler
+    mov eax, irq_bench_null
     call eax
     pop eax
     pop gs
@@ -120,3 +166,9 @@ irq_common_stub:
     popa
     add esp, 4
     iret
+
+irq_bench_lean:
+    push byte 0
+    jmp irq_bench_lean_common
+
+IRQ_COMMON_STUB irq_bench_lean_common, irq_bench_null
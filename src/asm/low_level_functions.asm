@@ -22,18 +22,174 @@ load_gdt_return:
     ret
 
 
-global out
-out:
-    mov al, [esp + 8] ; byte to write
-    mov dx, [esp + 4] ; port
-    out dx, al
+global load_page_directory
+load_page_directory:
+    mov eax, [esp + 4] ; physical address of the page directory
+    mov cr3, eax
     ret
 
 
-global in
-in:
-    mov dx, [esp + 4] ; port
-    in  al, dx        ; byte to return (convetion is to use ax to return values)
+global invalidate_page
+invalidate_page:
+    mov eax, [esp + 4] ; virtual address
+    invlpg [eax]
+    ret
+
+
+global read_cr2
+read_cr2:
+    mov eax, cr2 ; address that caused the last page fault
+    ret
+
+
+global read_cpuid
+read_cpuid:
+    push ebx           ; cpuid overwrites ebx, which C expects to be preserved
+    push edi
+    mov eax, [esp + 12] ; leaf
+    xor ecx, ecx        ; subleaf 0
+    cpuid
+    mov edi, [esp + 16]
+    mov [edi], eax
+    mov edi, [esp + 20]
+    mov [edi], ebx
+    mov edi, [esp + 24]
+    mov [edi], ecx
+    mov edi, [esp + 28]
+    mov [edi], edx
+    pop edi
+    pop ebx
+    ret
+
+
+global read_msr
+read_msr:
+    mov ecx, [esp + 4] ; msr
+    rdmsr
+    mov ecx, [esp + 8]
+    mov [ecx], eax     ; low half
+    mov ecx, [esp + 12]
+    mov [ecx], edx     ; high half
+    ret
+
+
+global write_msr
+write_msr:
+    mov ecx, [esp + 4]  ; msr
+    mov eax, [esp + 8]  ; low half
+    mov edx, [esp + 12] ; high half
+    wrmsr
+    ret
+
+
+; Intel SDM 11.11.8: MTRRs may only change with caches disabled and flushed
+; and the MTRRs themselves switched off.
+MSR_MTRR_DEF_TYPE equ 0x2FF
+MTRR_ENABLE equ 1 << 11
+CR0_CACHE_DISABLE equ 1 << 30
+CR0_NOT_WRITE_THROUGH equ 1 << 29
+
+global write_mtrr
+write_mtrr:
+    push ebx
+    push esi
+    pushf
+    cli
+    mov eax, cr0
+    or eax, CR0_CACHE_DISABLE
+    and eax, ~CR0_NOT_WRITE_THROUGH
+    mov cr0, eax
+    wbinvd
+    mov eax, cr3 ; flush the TLB
+    mov cr3, eax
+
+    mov ecx, MSR_MTRR_DEF_TYPE
+    rdmsr
+    mov ebx, eax ; keep the old default type
+    mov esi, edx
+    and eax, ~MTRR_ENABLE
+    wrmsr
+
+    mov ecx, [esp + 16] ; msr
+    mov eax, [esp + 20] ; low half
+    mov edx, [esp + 24] ; high half
+    wrmsr
+
+    mov ecx, MSR_MTRR_DEF_TYPE
+    mov eax, ebx
+    mov edx, esi
+    wrmsr
+
+    wbinvd
+    mov eax, cr3
+    mov cr3, eax
+    mov eax, cr0
+    and eax, ~CR0_CACHE_DISABLE
+    mov cr0, eax
+    popf
+    pop esi
+    pop ebx
+    ret
+
+
+global flush_write_combining
+flush_write_combining:
+    ; Any locked instruction drains the write-combining buffers, unlike sfence
+    ; this also works on CPUs without SSE
+    lock or dword [esp], 0
+    ret
+
+
+global save_and_disable_interrupts
+save_and_disable_interrupts:
+    pushf
+    pop eax ; previous flags, to pass to restore_interrupts
+    cli
+    ret
+
+
+global restore_interrupts
+restore_interrupts:
+    push dword [esp + 4]
+    popf
+    ret
+
+
+global clear_task_switched
+clear_task_switched:
+    clts
+    ret
+
+
+global set_task_switched
+set_task_switched:
+    mov eax, cr0
+    or eax, 1 << 3 ; TS, the next FPU/SSE instruction raises #NM
+    mov cr0, eax
+    ret
+
+
+global save_fpu_state
+save_fpu_state:
+    mov eax, [esp + 4]    ; save area, 16 byte aligned
+    cmp byte [esp + 8], 0 ; fxsr
+    je .fnsave
+    fxsave [eax]
+    ret
+.fnsave:
+    fnsave [eax]
+    ret
+
+
+global restore_fpu_state
+restore_fpu_state:
+    mov eax, [esp + 4]    ; save area
+    cmp byte [esp + 8], 0 ; fxsr
+    je .frstor
+    fxrstor [eax]
+    ret
+.frstor:
+    frstor [eax]
     ret
 
 
@@ -47,3 +203,10 @@ global halt
 halt:
     hlt
     ret
+
+
+global enable_interrupts_and_halt
+enable_interrupts_and_halt:
+    sti ; Interrupts are only taken after the next instruction, so none slips in before hlt
+    hlt
+    ret
@@ -2,6 +2,8 @@
 #include "keyboard.h"
 
 #define KEYBOARD_DATA_PORT 0x60
+#define KEYBOARD_STATUS_PORT 0x64
+#define KEYBOARD_OUTPUT_FULL 0x01       // Status bit, a byte waits in the data port
 #define SCANCODES_KNOWN 120
 #define EXTENDED_SCANCODE_PREFIX 0xE0
 
@@ -108,10 +110,8 @@ static bool shift_pressed = false;
 static bool caps_lock = false;
 static bool ctrl_pressed = false;
 
-/* Handles the keyboard interrupt */
-void keyboard_handler(__attribute__((unused)) u32 interrupt) {
-    const u8 scancode = in(KEYBOARD_DATA_PORT);
-    
+/* Translates a scancode read from the controller */
+static void handle_scancode(const u8 scancode) {
     // Check for extended scancode prefix
     if (scancode == EXTENDED_SCANCODE_PREFIX) {
         extended_scancode = true;
@@ -236,6 +236,17 @@ void keyboard_handler(__attribute__((unused)) u32 interrupt) {
     }
 }
 
+/* Handles the keyboard interrupt, when the controller has a scancode to read */
+static bool keyboard_handler(__attribute__((unused)) u32 interrupt) {
+    if (!(in(KEYBOARD_STATUS_PORT) & KEYBOARD_OUTPUT_FULL)) {
+        return false;
+    }
+    handle_scancode(in(KEYBOARD_DATA_PORT));
+    return true;
+}
+
+static interrupt_action_t keyboard_action = {keyboard_handler, "keyboard", 0};
+
 void map_keys_to_characters() {
     key_to_character[KEY_1]                       = '1';
     key_to_character[KEY_2]                       = '2';
@@ -306,7 +317,7 @@ void map_keys_to_characters() {
 
 void register_keyboard_interrupt_handler() {
     map_keys_to_characters();
-    set_interrupt_handler(INTERRUPT_KEYBOARD, keyboard_handler);
+    add_interrupt_handler(INTERRUPT_KEYBOARD, &keyboard_action);
 }
 
 void keyboard_set_handler(void (*handler)(struct keyboard_event event)) {
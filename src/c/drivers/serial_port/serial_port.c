@@ -31,6 +31,12 @@ void serial_print(const char *str) {
     }
 }
 
+void serial_write(const char *text, u32 length) {
+    for (u32 i = 0; i < length; i++) {
+        serial_print_char(text[i]);
+    }
+}
+
 void serial_log(enum log_level level, const char *message) {
     serial_print_char('[');
     switch (level) {
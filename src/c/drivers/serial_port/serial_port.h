@@ -1,6 +1,8 @@
 #ifndef SERIAL_H
 #define SERIAL_H
 
+#include "../../kernel/kernel.h"
+
 enum log_level {
     LOG_INFO = 1,
     LOG_ERROR,
@@ -18,6 +20,12 @@ extern void configure_default_serial_port();
  */
 extern void serial_print(const char *str);
 
+/**
+ * Writes length bytes of text to the default serial port as they are,
+ * kprintf_to sends its output through this.
+ */
+extern void serial_write(const char *text, u32 length);
+
 /**
  * Prints a message to serial following the logging format.
  * Each message is followed by \r\n.
@@ -1,18 +1,392 @@
 #include "../../kernel/kernel.h"
 #include "timer.h"
+#include "libk/mem.h"
+#include "kernel/work_queue.h"
 
-void (*custom_timer_interrupt_handler)() = 0;
+#define TIMER_PIT_CHANNEL0_PORT 0x40
+#define TIMER_PIT_COMMAND_PORT 0x43
+#define TIMER_PIT_CHANNEL0_RATE 0x34     // Channel 0, low then high byte, mode 2 (rate generator)
+#define TIMER_PIT_CHANNEL0_ONE_SHOT 0x30 // Channel 0, low then high byte, mode 0 (interrupt on terminal count)
+#define TIMER_PIT_MAX_COUNT 0xFFFF       // Longest one-shot, about 55 ms
+#define TIMER_NS_PER_SECOND 1000000000
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_SPAN ((u64)1 << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_LEVEL_BITS)) // Wheel ticks the wheel reaches ahead
 
-void timer_handler(__attribute__((unused)) u32 interrupt) {
-    if (custom_timer_interrupt_handler != 0) {
-        custom_timer_interrupt_handler();
+// Updated by the interrupt handler, read with interrupts disabled
+static u64 interrupts = 0;
+static u64 pit_cycles = 0;               // PIT input clock cycles up to the last tick, without a TSC
+
+static bool tickless = false;
+static u32 divisor = 0;                  // PIT cycles per tick, 0 until programmed or when tickless
+static u64 start_tsc = 0;                // TSC when the clock started, when tickless
+static bool expiring = false;            // Callbacks are running, the PIT is programmed after them
+
+// The wheel. A timer due at wheel tick t is in level 0 if t is less than
+// TIMER_WHEEL_SLOTS ticks ahead of wheel_next, in slot t % TIMER_WHEEL_SLOTS.
+// Otherwise it is in the lowest level whose slots cover it, in the slot of
+// its tick shifted down by the bits of the levels below. A higher level slot
+// is cascaded (its timers spread over the levels below) when the level below
+// it wraps around to slot 0.
+static ktimer_t* wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static u64 occupied[TIMER_WHEEL_LEVELS];   // Bit per slot that has timers
+static u64 wheel_next = 0;                 // Next wheel tick to run, all before it have run
+static u32 armed = 0;
+
+// Helper function to convert PIT input clock cycles to nanoseconds, exact to the nanosecond
+static u64 pit_cycles_to_ns(u64 cycles) {
+    u32 rest;
+    u64 seconds = div_u64(cycles, TIMER_PIT_FREQUENCY, &rest);
+    return seconds * TIMER_NS_PER_SECOND + div_u64((u64)rest * TIMER_NS_PER_SECOND, TIMER_PIT_FREQUENCY, 0);
+}
+
+// Helper function to get the first wheel tick a timer may run in, rounded up so it never runs early
+static inline u64 deadline_to_tick(u64 deadline) {
+    return (deadline + ((u64)1 << TIMER_WHEEL_TICK_SHIFT) - 1) >> TIMER_WHEEL_TICK_SHIFT;
+}
+
+// Helper function to find the first slot at or after start (going round) that has timers,
+// returns its distance from start or TIMER_WHEEL_SLOTS if none has
+static u32 next_occupied(u32 level, u32 start) {
+    u64 bits = occupied[level];
+    if (start > 0) {
+        bits = bits >> start | bits << (TIMER_WHEEL_SLOTS - start);
+    }
+    if (!bits) {
+        return TIMER_WHEEL_SLOTS;
+    }
+    return (u32)bits ? (u32)__builtin_ctz((u32)bits) : 32 + (u32)__builtin_ctz((u32)(bits >> 32));
+}
+
+// Helper function to put a timer into the slot of its deadline
+static void wheel_insert(ktimer_t* timer) {
+    u64 tick = deadline_to_tick(timer->deadline);
+    if (tick < wheel_next) {
+        tick = wheel_next;
+    } else if (tick - wheel_next >= TIMER_WHEEL_SPAN) {
+        tick = wheel_next + TIMER_WHEEL_SPAN - 1; // Waits in the last level, the cascade puts it further
+    }
+
+    u64 distance = tick - wheel_next;
+    u32 level = 0;
+    while (distance >> ((level + 1) * TIMER_WHEEL_LEVEL_BITS)) {
+        level++;
+    }
+    u32 slot = (u32)(tick >> (level * TIMER_WHEEL_LEVEL_BITS)) & TIMER_WHEEL_SLOT_MASK;
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->next = wheel[level][slot];
+    if (timer->next) {
+        timer->next->link = &timer->next;
+    }
+    timer->link = &wheel[level][slot];
+    wheel[level][slot] = timer;
+    occupied[level] |= (u64)1 << slot;
+    armed++;
+}
+
+// Helper function to take a timer out of its slot
+static void wheel_remove(ktimer_t* timer) {
+    *timer->link = timer->next;
+    if (timer->next) {
+        timer->next->link = timer->link;
+    }
+    if (!wheel[timer->level][timer->slot]) {
+        occupied[timer->level] &= ~((u64)1 << timer->slot);
+    }
+    timer->link = 0;
+    armed--;
+}
+
+// Helper function to take all timers out of a slot for cascading, returns them as a list
+static ktimer_t* wheel_take_slot(u32 level, u32 slot) {
+    ktimer_t* list = wheel[level][slot];
+    for (ktimer_t* timer = list; timer; timer = timer->next) {
+        timer->link = 0;
+        armed--;
     }
+    wheel[level][slot] = 0;
+    occupied[level] &= ~((u64)1 << slot);
+    return list;
 }
 
-void register_timer_interrupt_handler() {
-    set_interrupt_handler(INTERRUPT_TIMER, timer_handler);
+// Helper function to find the next wheel tick from wheel_next on at which
+// something happens: a level 0 slot with timers, or the wrap of level 0 if
+// higher levels have timers to cascade. Returns 0 without armed timers.
+static u64 next_event_tick() {
+    if (armed == 0) {
+        return 0;
+    }
+    u32 start = (u32)wheel_next & TIMER_WHEEL_SLOT_MASK;
+    u64 next = wheel_next + next_occupied(0, start);
+    for (u32 level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if (occupied[level]) {
+            u64 wrap = wheel_next + ((TIMER_WHEEL_SLOTS - start) & TIMER_WHEEL_SLOT_MASK);
+            return wrap < next ? wrap : next;
+        }
+    }
+    return next;
+}
+
+// Helper function to run the callback of a timer and account for it
+static void run_callback(ktimer_t* timer) {
+    u64 start = tickless ? cycles_now() : 0;
+    timer->callback(timer);
+    if (tickless) {
+        u64 ns = cycles_to_ns(cycles_now() - start);
+        timer->total_ns += ns;
+        if (ns > timer->max_ns) {
+            timer->max_ns = ns > 0xFFFFFFFF ? 0xFFFFFFFF : (u32)ns;
+        }
+    }
+    timer->runs++;
+}
+
+// Helper function to run a deferred timer's callback from the work queue
+static void run_deferred(u32 argument) {
+    ktimer_t* timer = (ktimer_t*)argument;
+    u32 flags = save_and_disable_interrupts();
+    bool pending = timer->work_pending;
+    timer->work_pending = false;
+    restore_interrupts(flags);
+
+    if (pending) {
+        run_callback(timer);
+    }
+}
+
+// Helper function to handle an expired timer, which is out of the wheel
+static void expire(ktimer_t* timer, u64 now) {
+    if (timer->period) {
+        // Armed again before the callback, which may still cancel it
+        timer->deadline += timer->period;
+        if (timer->deadline <= now && timer->period <= 0xFFFFFFFF) {
+            u64 missed = div_u64(now - timer->deadline, (u32)timer->period, 0) + 1;
+            timer->deadline += timer->period * missed;
+        }
+        while (timer->deadline <= now) {
+            timer->deadline += timer->period; // Periods too long to divide by, a few at most
+        }
+        wheel_insert(timer);
+    }
+
+    if (!timer->deferred) {
+        run_callback(timer);
+    } else if (!timer->work_pending) {
+        timer->work_pending = work_queue_push(run_deferred, (u32)timer);
+    }
+}
+
+// Helper function to run all wheel ticks up to the current time
+static void run_wheel() {
+    u64 now = clock_monotonic_ns();
+    u64 now_tick = now >> TIMER_WHEEL_TICK_SHIFT;
+
+    while (armed > 0) {
+        u64 tick = next_event_tick();
+        if (tick > now_tick) {
+            break;
+        }
+        wheel_next = tick;
+
+        // Cascade the levels that wrap around with this tick, the top one first
+        u32 level = 0;
+        while (level + 1 < TIMER_WHEEL_LEVELS && ((tick >> (level * TIMER_WHEEL_LEVEL_BITS)) & TIMER_WHEEL_SLOT_MASK) == 0) {
+            level++;
+        }
+        for (; level > 0; level--) {
+            u32 slot = (u32)(tick >> (level * TIMER_WHEEL_LEVEL_BITS)) & TIMER_WHEEL_SLOT_MASK;
+            ktimer_t* timer = wheel_take_slot(level, slot);
+            while (timer) {
+                ktimer_t* next = timer->next;
+                wheel_insert(timer);
+                timer = next;
+            }
+        }
+
+        // Expire the slot from a list of its own: timers armed by the callbacks
+        // for this tick or earlier go to the next one, and for a full turn
+        // later into this slot again, which must not run them now. The list
+        // is linked like a slot, so callbacks can still cancel timers on it.
+        u32 slot = (u32)tick & TIMER_WHEEL_SLOT_MASK;
+        ktimer_t* pending = wheel[0][slot];
+        wheel[0][slot] = 0;
+        occupied[0] &= ~((u64)1 << slot);
+        if (pending) {
+            pending->link = &pending;
+        }
+        wheel_next = tick + 1;
+        while (pending) {
+            ktimer_t* timer = pending;
+            wheel_remove(timer);
+            expire(timer, now);
+        }
+    }
+    if (wheel_next <= now_tick) {
+        wheel_next = now_tick + 1;
+    }
+}
+
+// Helper function to start a one-shot for the next wheel tick with something
+// to do, or for the longest the PIT can count if that is further away.
+// Nothing is programmed without armed timers, the interrupt then simply
+// stays away.
+static void program_next_deadline() {
+    if (!tickless || expiring || armed == 0) {
+        return;
+    }
+
+    u64 deadline = next_event_tick() << TIMER_WHEEL_TICK_SHIFT;
+    u64 now = clock_monotonic_ns();
+    u64 delay = deadline > now ? deadline - now : 0;
+    u32 count = TIMER_PIT_MAX_COUNT;
+    if (delay < pit_cycles_to_ns(TIMER_PIT_MAX_COUNT)) {
+        // Round up, an early interrupt would only find nothing due yet
+        count = (u32)div_u64(delay * TIMER_PIT_FREQUENCY + TIMER_NS_PER_SECOND - 1, TIMER_NS_PER_SECOND, 0);
+        if (count < 1) {
+            count = 1;
+        }
+    }
+
+    out(TIMER_PIT_COMMAND_PORT, TIMER_PIT_CHANNEL0_ONE_SHOT);
+    out(TIMER_PIT_CHANNEL0_PORT, count & 0xFF);
+    out(TIMER_PIT_CHANNEL0_PORT, (count >> 8) & 0xFF);
+}
+
+// Helper function to handle the PIT interrupt, the only device on its line
+static bool timer_handler(__attribute__((unused)) u32 interrupt) {
+    interrupts++;
+    pit_cycles += divisor;
+
+    expiring = true;
+    run_wheel();
+    expiring = false;
+    program_next_deadline();
+    return true;
+}
+
+static interrupt_action_t timer_action = {timer_handler, "timer", 0};
+
+void register_timer_interrupt_handler(u32 frequency) {
+    tickless = tsc_get_khz() > 0;
+    if (tickless) {
+        start_tsc = cycles_now();
+        divisor = 0;
+        // Stops the periodic interrupts the BIOS left running, mode 0 waits for a count
+        out(TIMER_PIT_COMMAND_PORT, TIMER_PIT_CHANNEL0_ONE_SHOT);
+    } else {
+        // The divisor is 16 bits, where 0 stands for 65536
+        divisor = frequency ? (TIMER_PIT_FREQUENCY + frequency / 2) / frequency : 0x10000;
+        if (divisor < 1) {
+            divisor = 1;
+        } else if (divisor > 0x10000) {
+            divisor = 0x10000;
+        }
+        out(TIMER_PIT_COMMAND_PORT, TIMER_PIT_CHANNEL0_RATE);
+        out(TIMER_PIT_CHANNEL0_PORT, divisor & 0xFF);
+        out(TIMER_PIT_CHANNEL0_PORT, (divisor >> 8) & 0xFF);
+    }
+
+    add_interrupt_handler(INTERRUPT_TIMER, &timer_action);
+}
+
+void timer_init(ktimer_t* timer, const char* name, void (*callback)(ktimer_t* timer)) {
+    memset(timer, 0, sizeof(ktimer_t));
+    timer->name = name;
+    timer->callback = callback;
+}
+
+void timer_init_deferred(ktimer_t* timer, const char* name, void (*callback)(ktimer_t* timer)) {
+    timer_init(timer, name, callback);
+    timer->deferred = true;
+}
+
+void timer_arm(ktimer_t* timer, u64 deadline) {
+    u32 flags = save_and_disable_interrupts();
+    if (timer->link) {
+        wheel_remove(timer);
+    }
+    timer->work_pending = false;
+    timer->deadline = deadline;
+    timer->period = 0;
+    wheel_insert(timer);
+    program_next_deadline();
+    restore_interrupts(flags);
+}
+
+void timer_arm_periodic(ktimer_t* timer, u64 period) {
+    u32 flags = save_and_disable_interrupts();
+    if (timer->link) {
+        wheel_remove(timer);
+    }
+    timer->work_pending = false;
+    timer->deadline = clock_monotonic_ns() + period;
+    timer->period = period;
+    wheel_insert(timer);
+    program_next_deadline();
+    restore_interrupts(flags);
+}
+
+bool timer_cancel(ktimer_t* timer) {
+    u32 flags = save_and_disable_interrupts();
+    bool was_armed = timer->link != 0;
+    timer->work_pending = false;
+    if (was_armed) {
+        // A one-shot programmed for it is left running, it just finds nothing to do
+        wheel_remove(timer);
+    }
+    restore_interrupts(flags);
+    return was_armed;
+}
+
+bool timer_is_armed(const ktimer_t* timer) {
+    return timer->link != 0;
+}
+
+bool timer_is_tickless() {
+    return tickless;
+}
+
+u32 timer_get_frequency() {
+    return divisor ? (TIMER_PIT_FREQUENCY + divisor / 2) / divisor : 0;
+}
+
+u64 timer_get_interrupts() {
+    u32 flags = save_and_disable_interrupts();
+    u64 count = interrupts;
+    restore_interrupts(flags);
+    return count;
+}
+
+u32 timer_get_armed() {
+    return armed;
+}
+
+u32 timer_get_stats(ktimer_t* stats, u32 max) {
+    u32 count = 0;
+    u32 flags = save_and_disable_interrupts();
+    for (u32 level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (u32 slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            for (ktimer_t* timer = wheel[level][slot]; timer && count < max; timer = timer->next) {
+                stats[count++] = *timer;
+            }
+        }
+    }
+    restore_interrupts(flags);
+    return count;
+}
+
+u64 clock_monotonic_ns() {
+    if (tickless) {
+        return cycles_to_ns(cycles_now() - start_tsc);
+    }
+
+    u32 flags = save_and_disable_interrupts();
+    u64 cycles = pit_cycles;
+    restore_interrupts(flags);
+    return pit_cycles_to_ns(cycles);
 }
 
-extern void timer_set_handler(void (*handler)()) {
-    custom_timer_interrupt_handler = handler;
+u32 clock_monotonic_ms() {
+    return (u32)div_u64(clock_monotonic_ns(), TIMER_NS_PER_MS, 0);
 }
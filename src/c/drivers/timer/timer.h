@@ -1,16 +1,132 @@
 #ifndef TIMER_H
 #define TIMER_H
 
+#include "../../kernel/kernel.h"
+
+#define TIMER_PIT_FREQUENCY 1193182  // Input clock of the 8253/8254 in Hz
+#define TIMER_DEFAULT_FREQUENCY 1000 // Tick rate the PIT runs at when there is no TSC to go tickless with
+#define TIMER_NS_PER_MS 1000000
+
+// Timers are kept in a hierarchical wheel: TIMER_WHEEL_LEVELS levels of
+// TIMER_WHEEL_SLOTS slots. Level 0 has a slot per wheel tick, each level up
+// a slot per whole turn of the level below, where timers wait until they
+// are close enough to cascade down. Arming and cancelling are O(1) however
+// many timers there are, and nothing is scanned per tick.
+#define TIMER_WHEEL_TICK_SHIFT 20    // A wheel tick is 2^20 ns (about 1 ms), the resolution of timers
+#define TIMER_WHEEL_LEVEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_LEVELS 4         // 2^24 wheel ticks, about 4.9 hours, later deadlines take extra cascades
+
+/**
+ * A software timer. Callers own the structure, which must stay in place
+ * while armed, and set it up once with timer_init.
+ */
+typedef struct ktimer {
+    struct ktimer* next;             // Next timer in its wheel slot
+    struct ktimer** link;            // What points to it in its wheel slot, 0 if not armed
+    u64 deadline;                    // clock_monotonic_ns value it expires at
+    u64 period;                      // Nanoseconds between expiries, 0 for a one-shot timer
+    void (*callback)(struct ktimer* timer);
+    const char* name;                // Shown by timer_get_stats
+    u8 level;                        // Wheel slot it is in
+    u8 slot;
+    bool deferred;                   // The callback runs from the work queue
+    bool work_pending;               // An expiry is queued to run, arming and cancelling drop it
+
+    // Accounting, callback times are measured with the TSC (0 without one)
+    u32 runs;
+    u32 max_ns;
+    u64 total_ns;
+} ktimer_t;
+
+/**
+ * Sets up PIT channel 0 and registers the timer interrupt handler, which
+ * keeps the clock and runs the callbacks of expired timers. Call tsc_init
+ * before. With a TSC the clock comes from it and the PIT runs in one-shot
+ * mode, programmed for the next wheel tick with something to do only, so an
+ * idle CPU is not woken up unless a timer is due. Without one, the PIT interrupts at the
+ * given frequency (in Hz, rounded to what the divisor allows) to count time
+ * and deadlines are checked on every tick.
+ */
+extern void register_timer_interrupt_handler(u32 frequency);
+
+/**
+ * Sets up timer to call callback when it expires. Callbacks run in the timer
+ * interrupt and may arm and cancel timers, including their own.
+ */
+extern void timer_init(ktimer_t* timer, const char* name, void (*callback)(ktimer_t* timer));
+
+/**
+ * Sets up timer like timer_init, but to have callback run from the work
+ * queue in the main loop, with interrupts enabled, for callbacks that take
+ * longer than an interrupt handler should. Expiries that come while one is
+ * still queued are merged into it, and an expiry still queued when the timer
+ * is armed again or cancelled does not run.
+ */
+extern void timer_init_deferred(ktimer_t* timer, const char* name, void (*callback)(ktimer_t* timer));
+
+/**
+ * Arms timer to expire once clock_monotonic_ns reaches deadline, at most a
+ * wheel tick late. A deadline in the past expires on the next wheel tick.
+ * Arming an armed timer moves it to the new deadline.
+ */
+extern void timer_arm(ktimer_t* timer, u64 deadline);
+
+/**
+ * Arms timer to expire every period nanoseconds, the first time one period
+ * from now. Expiries follow each other at exactly period apart, periods
+ * that were missed (because interrupts were off too long) are skipped
+ * instead of made up for in a burst.
+ */
+extern void timer_arm_periodic(ktimer_t* timer, u64 period);
+
+/**
+ * Disarms timer, returns whether it was armed.
+ */
+extern bool timer_cancel(ktimer_t* timer);
+
+/**
+ * Returns whether timer is armed.
+ */
+extern bool timer_is_armed(const ktimer_t* timer);
+
+/**
+ * Returns whether the PIT runs in one-shot mode (see register_timer_interrupt_handler).
+ */
+extern bool timer_is_tickless();
+
+/**
+ * Returns the tick rate in Hz, 0 when tickless.
+ */
+extern u32 timer_get_frequency();
+
+/**
+ * Returns the number of timer interrupts since register_timer_interrupt_handler.
+ */
+extern u64 timer_get_interrupts();
+
+/**
+ * Returns the number of armed timers.
+ */
+extern u32 timer_get_armed();
+
+/**
+ * Copies up to max armed timers to stats, for their name, deadline, period
+ * and accounting (their links are of no use). Returns how many were copied.
+ */
+extern u32 timer_get_stats(ktimer_t* stats, u32 max);
+
 /**
- * Registers timer interrupt handler that delegates handling
- * of the interrupt to the registered interrupt handler (see timer_set_handler).
+ * Returns nanoseconds since the PIT was programmed. Tickless this comes from
+ * the TSC, otherwise from the PIT ticks, so the resolution is a tick. Never
+ * goes backwards.
  */
-extern void register_timer_interrupt_handler();
+extern u64 clock_monotonic_ns();
 
 /**
- * Sets the given function as the handler of the timer interrupts. Calling
- * this function twice will override the previously set function value.
+ * Returns clock_monotonic_ns in milliseconds, wrapping around after 49 days.
+ * Compare two values by subtracting them.
  */
-extern void timer_set_handler(void (*handler)());
+extern u32 clock_monotonic_ms();
 
 #endif
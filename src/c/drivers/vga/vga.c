@@ -1,8 +1,43 @@
 #include "vga.h"
+#include "memory/paging.h"
+#include "memory/vm.h"
+#include "libk/mem.h"
+#include "libk/string.h"
+
+#define VGA_CPUID_FEATURE_MTRR (1 << 12)  // cpuid leaf 1, edx
+#define VGA_MSR_MTRR_CAP 0xFE
+#define VGA_MSR_MTRR_DEF_TYPE 0x2FF
+#define VGA_MSR_MTRR_FIX16K_A0000 0x259   // Eight 16 KiB ranges from 0xA0000, one type byte each
+#define VGA_MTRR_CAP_FIXED (1 << 8)
+#define VGA_MTRR_CAP_WRITE_COMBINING (1 << 10)
+#define VGA_MTRR_FIXED_ENABLED (1 << 10)
+#define VGA_MTRR_ENABLED (1 << 11)
+#define VGA_MTRR_TEXT_RANGES 0xFFFF0000   // High half bytes 2 and 3: 0xB8000-0xBFFFF
+#define VGA_MTRR_TEXT_WRITE_COMBINING 0x01010000
+#define VGA_BASELINE_ROUNDS 10            // Uncached redraws timed before the MTRR switch
+#define VGA_CRTC_INDEX_PORT 0x3D4         // Data register at 0x3D5
+#define VGA_CRTC_CURSOR_START 0x0A
+#define VGA_CRTC_CURSOR_END 0x0B
+#define VGA_CRTC_CURSOR_HIGH 0x0E
+#define VGA_CRTC_CURSOR_LOW 0x0F
+#define VGA_CURSOR_UNKNOWN 0xFFFF         // Hardware cursor position not known
 
 static cursor_pos_t cursor = {0, 0};
 static u8 current_color = ((VGA_DEFAULT_FG) | ((VGA_DEFAULT_BG) << 4));
 
+// Video memory is slow to read (uncached or write-combining), so the driver
+// keeps a copy of the screen and only ever writes the framebuffer
+static vga_entry_t* framebuffer = (vga_entry_t*)VGA_FRAMEBUFFER_ADDR;
+static vga_entry_t screen[VGA_WIDTH * VGA_HEIGHT] __attribute__((aligned(4)));
+static bool write_combining = false;
+static bool mtrr_write_combining = false;   // The direct map is write-combining too
+static u32 uncached_baseline = 0;           // Cycles per uncached redraw, timed before the MTRR switch
+
+// The CRTC is only told about the cursor once a print call or a batch of
+// drawing (vga_begin_update/vga_end_update) is done, and only if it moved
+static u16 hardware_cursor = VGA_CURSOR_UNKNOWN;
+static u32 update_depth = 0;
+
 // Helper macro to create color byte
 #define VGA_COLOR_MAKE(fg, bg) ((fg) | ((bg) << 4))
 
@@ -19,18 +54,177 @@ static inline u16 vga_entry_index(u8 x, u8 y) {
     return y * VGA_WIDTH + x;
 }
 
+// Helper function to write one entry to the screen copy and the framebuffer
+static inline void vga_put_entry(u16 index, vga_entry_t entry) {
+    screen[index] = entry;
+    framebuffer[index] = entry;
+}
+
+// Helper function to copy the whole screen to a framebuffer mapping
+static void vga_redraw(vga_entry_t* target) {
+    memcpy(target, screen, sizeof(screen));
+}
+
+// Helper function to move the hardware cursor to the cursor, unless it is
+// there already or drawing is being batched
+static void vga_update_cursor() {
+    if (update_depth > 0) {
+        return;
+    }
+    u16 pos = vga_entry_index(cursor.x, cursor.y);
+    if (pos == hardware_cursor) {
+        return;
+    }
+    hardware_cursor = pos;
+
+    // One outw per register: index in the low byte, value in the high byte
+    outw(VGA_CRTC_INDEX_PORT, (pos & 0xFF00) | VGA_CRTC_CURSOR_HIGH);
+    outw(VGA_CRTC_INDEX_PORT, (pos << 8) | VGA_CRTC_CURSOR_LOW);
+}
+
+// Helper function to move the cursor to the start of the next line, scrolling
+// at the bottom. Like vga_put_char it leaves the hardware cursor alone.
+static void vga_next_line() {
+    cursor.x = 0;
+    cursor.y++;
+    
+    if (cursor.y >= VGA_HEIGHT) {
+        vga_scroll();
+        cursor.y = VGA_HEIGHT - 1;
+    }
+}
+
+// Helper function to put a character at the cursor and advance it. The
+// hardware cursor is not moved, callers update it once they are done.
+static void vga_put_char(char c, u8 color) {
+    if (c == '\n') {
+        vga_next_line();
+        return;
+    }
+    
+    if (c == '\r') {
+        cursor.x = 0;
+        return;
+    }
+    
+    if (c == '\b') {
+        if (cursor.x > 0) {
+            cursor.x--;
+            vga_put_entry(vga_entry_index(cursor.x, cursor.y), vga_make_entry(' ', current_color));
+        }
+        return;
+    }
+    
+    // Handle printable characters
+    if (c >= 32 && c <= 126) {
+        u16 index = vga_entry_index(cursor.x, cursor.y);
+        vga_put_entry(index, vga_make_entry(c, color));
+        
+        cursor.x++;
+        if (cursor.x >= VGA_WIDTH) {
+            vga_next_line();
+        }
+    }
+}
+
+// Helper function to make the text mode framebuffer write-combining with the
+// fixed range MTRR, for CPUs that have MTRRs but no PAT
+static bool vga_enable_mtrr_write_combining() {
+    u32 eax, ebx, ecx, edx;
+    read_cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & VGA_CPUID_FEATURE_MTRR)) {
+        return false;
+    }
+
+    u32 low, high;
+    read_msr(VGA_MSR_MTRR_CAP, &low, &high);
+    if (!(low & VGA_MTRR_CAP_FIXED) || !(low & VGA_MTRR_CAP_WRITE_COMBINING)) {
+        return false;
+    }
+    read_msr(VGA_MSR_MTRR_DEF_TYPE, &low, &high);
+    if (!(low & VGA_MTRR_ENABLED) || !(low & VGA_MTRR_FIXED_ENABLED)) {
+        return false;
+    }
+
+    read_msr(VGA_MSR_MTRR_FIX16K_A0000, &low, &high);
+    high = (high & ~VGA_MTRR_TEXT_RANGES) | VGA_MTRR_TEXT_WRITE_COMBINING;
+    write_mtrr(VGA_MSR_MTRR_FIX16K_A0000, low, high);
+    return true;
+}
+
 void vga_init() {
     vga_clear();
     vga_set_cursor(0, 0);
 }
 
+// Helper function to time redraws of the screen to a framebuffer mapping, in TSC cycles per redraw
+static u32 time_redraws(vga_entry_t* target, u32 rounds) {
+    // Redraws what is on the screen already, so nothing visibly changes
+    u64 start = cycles_now();
+    for (u32 round = 0; round < rounds; round++) {
+        vga_redraw(target);
+        vga_flush();
+    }
+    return (u32)div_u64(cycles_now() - start, rounds, 0);
+}
+
+bool vga_enable_write_combining() {
+    if (paging_enable_write_combining()) {
+        u32 address = vm_map_physical(VGA_FRAMEBUFFER_PHYSICAL_ADDR, VGA_FRAMEBUFFER_SIZE,
+                                      PAGE_WRITABLE | PAGE_WRITE_COMBINING);
+        if (address == 0) {
+            return false;
+        }
+        framebuffer = (vga_entry_t*)address;
+    } else {
+        // The MTRR covers every mapping of the framebuffer, the direct map as
+        // well, so the uncached redraw can only be timed before the switch
+        if (tsc_get_khz() != 0) {
+            uncached_baseline = time_redraws((vga_entry_t*)VGA_FRAMEBUFFER_ADDR, VGA_BASELINE_ROUNDS);
+        }
+        if (!vga_enable_mtrr_write_combining()) {
+            return false; // The direct map (and with it the framebuffer) stays uncached
+        }
+        mtrr_write_combining = true;
+    }
+    write_combining = true;
+    return true;
+}
+
+void vga_begin_update() {
+    update_depth++;
+}
+
+void vga_end_update() {
+    update_depth--;
+    vga_update_cursor();
+    vga_flush();
+}
+
+void vga_flush() {
+    if (write_combining) {
+        flush_write_combining();
+    }
+}
+
+bool vga_benchmark_redraw(u32 rounds, u32* uncached_cycles, u32* current_cycles) {
+    if (tsc_get_khz() == 0) {
+        return false;
+    }
+    *uncached_cycles = mtrr_write_combining ? uncached_baseline
+                                            : time_redraws((vga_entry_t*)VGA_FRAMEBUFFER_ADDR, rounds);
+    *current_cycles = time_redraws(framebuffer, rounds);
+    return true;
+}
+
 void vga_clear() {
-    vga_entry_t* framebuffer = (vga_entry_t*)VGA_FRAMEBUFFER_ADDR;
     vga_entry_t blank = vga_make_entry(' ', current_color);
     
     for (u16 i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) {
-        framebuffer[i] = blank;
+        screen[i] = blank;
     }
+    vga_redraw(framebuffer);
+    vga_flush();
     
     cursor.x = 0;
     cursor.y = 0;
@@ -42,12 +236,7 @@ void vga_set_cursor(u8 x, u8 y) {
     
     cursor.x = x;
     cursor.y = y;
-    
-    u16 pos = vga_entry_index(x, y);
-    out(0x3D4, 14);
-    out(0x3D5, ((pos >> 8) & 0x00FF));
-    out(0x3D4, 15);
-    out(0x3D5, pos & 0x00FF);
+    vga_update_cursor();
 }
 
 cursor_pos_t vga_get_cursor() {
@@ -59,36 +248,16 @@ void vga_putchar(char c) {
 }
 
 void vga_putchar_color(char c, u8 fg_color, u8 bg_color) {
+    vga_put_char(c, VGA_COLOR_MAKE(fg_color, bg_color));
+    vga_update_cursor();
+}
+
+void vga_write(const char* text, u32 length, u8 fg_color, u8 bg_color) {
     u8 color = VGA_COLOR_MAKE(fg_color, bg_color);
-    
-    if (c == '\n') {
-        vga_newline();
-        return;
-    }
-    
-    if (c == '\r') {
-        vga_carriage_return();
-        return;
+    for (u32 i = 0; i < length; i++) {
+        vga_put_char(text[i], color);
     }
-    
-    if (c == '\b') {
-        vga_backspace();
-        return;
-    }
-    
-    // Handle printable characters
-    if (c >= 32 && c <= 126) {
-        vga_entry_t* framebuffer = (vga_entry_t*)VGA_FRAMEBUFFER_ADDR;
-        u16 index = vga_entry_index(cursor.x, cursor.y);
-        framebuffer[index] = vga_make_entry(c, color);
-        
-        cursor.x++;
-        if (cursor.x >= VGA_WIDTH) {
-            vga_newline();
-        }
-    }
-    
-    vga_set_cursor(cursor.x, cursor.y);
+    vga_update_cursor();
 }
 
 void vga_print(const char* str) {
@@ -96,56 +265,41 @@ void vga_print(const char* str) {
 }
 
 void vga_print_color(const char* str, u8 fg_color, u8 bg_color) {
-    while (*str) {
-        vga_putchar_color(*str, fg_color, bg_color);
-        str++;
-    }
+    vga_write(str, strlen(str), fg_color, bg_color);
 }
 
 void vga_newline() {
-    cursor.x = 0;
-    cursor.y++;
-    
-    if (cursor.y >= VGA_HEIGHT) {
-        vga_scroll();
-        cursor.y = VGA_HEIGHT - 1;
-    }
-    
-    vga_set_cursor(cursor.x, cursor.y);
+    vga_next_line();
+    vga_update_cursor();
 }
 
 void vga_scroll() {
-    vga_entry_t* framebuffer = (vga_entry_t*)VGA_FRAMEBUFFER_ADDR;
-    
-    // Move all lines up by one
-    for (u8 y = 0; y < VGA_HEIGHT - 1; y++) {
-        for (u8 x = 0; x < VGA_WIDTH; x++) {
-            u16 src_index = vga_entry_index(x, y + 1);
-            u16 dst_index = vga_entry_index(x, y);
-            framebuffer[dst_index] = framebuffer[src_index];
-        }
-    }
+    // Move all lines up by one in the screen copy
+    memmove(&screen[0], &screen[VGA_WIDTH], (VGA_HEIGHT - 1) * VGA_WIDTH * sizeof(vga_entry_t));
     
     // Clear the last line
     vga_entry_t blank = vga_make_entry(' ', current_color);
     for (u8 x = 0; x < VGA_WIDTH; x++) {
         u16 index = vga_entry_index(x, VGA_HEIGHT - 1);
-        framebuffer[index] = blank;
+        screen[index] = blank;
     }
+
+    // Then write it out in one sequential pass, without reading video memory
+    vga_redraw(framebuffer);
+    vga_flush();
 }
 
 void vga_carriage_return() {
     cursor.x = 0;
-    vga_set_cursor(cursor.x, cursor.y);
+    vga_update_cursor();
 }
 
 void vga_backspace() {
     if (cursor.x > 0) {
         cursor.x--;
-        vga_entry_t* framebuffer = (vga_entry_t*)VGA_FRAMEBUFFER_ADDR;
         u16 index = vga_entry_index(cursor.x, cursor.y);
-        framebuffer[index] = vga_make_entry(' ', current_color);
-        vga_set_cursor(cursor.x, cursor.y);
+        vga_put_entry(index, vga_make_entry(' ', current_color));
+        vga_update_cursor();
     }
 }
 
@@ -158,13 +312,10 @@ u8 vga_get_color() {
 }
 
 void vga_disable_cursor() {
-    out(0x3D4, 0x0A);
-    out(0x3D5, 0x20); // Set cursor start to 32 (disable cursor)
+    outw(VGA_CRTC_INDEX_PORT, (0x20 << 8) | VGA_CRTC_CURSOR_START); // Set cursor start to 32 (disable cursor)
 }
 
 void vga_enable_cursor(u8 start_line, u8 end_line) {
-    out(0x3D4, 0x0A);
-    out(0x3D5, (start_line & 0x0F) | 0x20); // Set cursor start
-    out(0x3D4, 0x0B);
-    out(0x3D5, (end_line & 0x0F) | 0x20);   // Set cursor end
+    outw(VGA_CRTC_INDEX_PORT, (((start_line & 0x0F) | 0x20) << 8) | VGA_CRTC_CURSOR_START); // Set cursor start
+    outw(VGA_CRTC_INDEX_PORT, (((end_line & 0x0F) | 0x20) << 8) | VGA_CRTC_CURSOR_END);     // Set cursor end
 }
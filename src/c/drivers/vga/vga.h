@@ -5,7 +5,9 @@
 
 #define VGA_WIDTH 80
 #define VGA_HEIGHT 25
-#define VGA_FRAMEBUFFER_ADDR 0xb8000
+#define VGA_FRAMEBUFFER_PHYSICAL_ADDR 0xb8000
+#define VGA_FRAMEBUFFER_ADDR PHYS_TO_VIRT(VGA_FRAMEBUFFER_PHYSICAL_ADDR) // Uncached through the direct map
+#define VGA_FRAMEBUFFER_SIZE (VGA_WIDTH * VGA_HEIGHT * 2)
 
 // VGA color codes
 #define VGA_COLOR_BLACK 0
@@ -44,6 +46,26 @@ typedef struct {
 // Initialize VGA driver
 void vga_init();
 
+// Map the framebuffer write-combining (PAT, or the VGA MTRR on CPUs without
+// PAT), needs the frame allocator. Returns false if the CPU supports neither.
+// Stores may then sit in the CPU until vga_flush.
+bool vga_enable_write_combining();
+
+// Push buffered framebuffer stores to the screen, call after bulk updates
+void vga_flush();
+
+// Batch drawing of a whole frame: until the matching vga_end_update the
+// hardware cursor is not moved. vga_end_update moves it once and flushes.
+void vga_begin_update();
+void vga_end_update();
+
+// Redraw the whole screen rounds times, once through the uncached direct map
+// and once through the framebuffer mapping in use. Reports TSC cycles per redraw.
+// With the MTRR fallback the direct map is write-combining as well, the
+// uncached time is then the one taken at boot before the switch. Returns false
+// without a calibrated TSC.
+bool vga_benchmark_redraw(u32 rounds, u32* uncached_cycles, u32* current_cycles);
+
 // Clear screen
 void vga_clear();
 
@@ -65,6 +87,10 @@ void vga_putchar(char c);
 // Print character with specific color
 void vga_putchar_color(char c, u8 fg_color, u8 bg_color);
 
+// Print length characters of text with color, moving the hardware cursor
+// once at the end. This is where kprintf output goes.
+void vga_write(const char* text, u32 length, u8 fg_color, u8 bg_color);
+
 // Print string
 void vga_print(const char* str);
 
@@ -1,11 +1,14 @@
 #include "editor/editor.h"
 #include "drivers/keyboard/keyboard.h"
 #include "shell/shell.h"
+#include "libk/mem.h"
+#include "libk/printf.h"
 
 static editor_state_t editor_state;
 
 void editor_init() {
     editor_state.current_file = 0;
+    editor_state.content = 0;
     editor_state.cursor_position = 0;
     editor_state.start_position = 0;
     editor_state.scroll_offset = 0;
@@ -29,6 +32,7 @@ bool editor_open_file(const char* filename) {
     }
     
     editor_state.current_file = file;
+    editor_state.content = fs_lock_content(file);
     editor_state.cursor_position = 0;
     editor_state.start_position = 0;
     editor_state.is_active = true;
@@ -50,6 +54,7 @@ bool editor_create_new_file(const char* filename) {
     }
     
     editor_state.current_file = file;
+    editor_state.content = fs_lock_content(file);
     editor_state.cursor_position = 0;
     editor_state.start_position = 0;
     editor_state.is_active = true;
@@ -149,6 +154,7 @@ void editor_draw() {
     // Update total lines count
     editor_state.total_lines = editor_count_lines();
     
+    vga_begin_update(); // One cursor update for the whole frame
     vga_clear();
     vga_set_cursor(0, 0);
     
@@ -183,7 +189,7 @@ void editor_draw() {
     
     // Skip to scroll offset line
     while (pos < content_len && line_count < editor_state.scroll_offset) {
-        if (editor_state.current_file->content[pos] == '\n') {
+        if (editor_state.content[pos] == '\n') {
             line_count++;
             line_start = pos + 1;
         }
@@ -197,7 +203,7 @@ void editor_draw() {
         
         // Display current line
         while (pos < content_len && current_col < EDITOR_MAX_COLS - 2) {
-            char ch = editor_state.current_file->content[pos];
+            char ch = editor_state.content[pos];
             
             if (pos == editor_state.cursor_position) {
                 vga_putchar_color(ch == '\n' ? ' ' : ch, VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
@@ -242,92 +248,29 @@ void editor_draw() {
     }
     
     // Draw footer with line and column info
-    vga_print_color("Line: ", VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
-    
     // Calculate current line number
     u16 current_line_num = 1;
     for (u16 i = 0; i < editor_state.cursor_position && i < content_len; i++) {
-        if (editor_state.current_file->content[i] == '\n') {
+        if (editor_state.content[i] == '\n') {
             current_line_num++;
         }
     }
     
-    char line_str[8];
-    u16 line_len = 0;
-    u16 temp_line = current_line_num;
-    if (temp_line == 0) {
-        line_str[line_len++] = '0';
-    } else {
-        while (temp_line > 0) {
-            line_str[line_len++] = '0' + (temp_line % 10);
-            temp_line /= 10;
-        }
-    }
-    line_str[line_len] = '\0';
-    
-    // Reverse the string
-    for (u16 i = 0; i < line_len / 2; i++) {
-        char temp = line_str[i];
-        line_str[i] = line_str[line_len - 1 - i];
-        line_str[line_len - 1 - i] = temp;
-    }
-    
-    vga_print(line_str);
-    vga_print_color(" Col: ", VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
-    
     // Calculate current column number
     u16 current_col_num = 1;
     u16 line_start_pos = editor_state.cursor_position;
-    while (line_start_pos > 0 && editor_state.current_file->content[line_start_pos - 1] != '\n') {
+    while (line_start_pos > 0 && editor_state.content[line_start_pos - 1] != '\n') {
         line_start_pos--;
         current_col_num++;
     }
     
-    char col_str[8];
-    u16 col_len = 0;
-    u16 temp_col = current_col_num;
-    if (temp_col == 0) {
-        col_str[col_len++] = '0';
-    } else {
-        while (temp_col > 0) {
-            col_str[col_len++] = '0' + (temp_col % 10);
-            temp_col /= 10;
-        }
-    }
-    col_str[col_len] = '\0';
-    
-    // Reverse the string
-    for (u16 i = 0; i < col_len / 2; i++) {
-        char temp = col_str[i];
-        col_str[i] = col_str[col_len - 1 - i];
-        col_str[col_len - 1 - i] = temp;
-    }
-    
-    vga_print(col_str);
-    vga_print_color(" Size: ", VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
-    
-    char size_str[8];
-    u16 size_num = editor_state.current_file->content_length;
-    u16 size_len = 0;
-    if (size_num == 0) {
-        size_str[size_len++] = '0';
-    } else {
-        u16 temp = size_num;
-        while (temp > 0) {
-            size_str[size_len++] = '0' + (temp % 10);
-            temp /= 10;
-        }
-    }
-    size_str[size_len] = '\0';
-    
-    // Reverse the string
-    for (u16 i = 0; i < size_len / 2; i++) {
-        char temp = size_str[i];
-        size_str[i] = size_str[size_len - 1 - i];
-        size_str[size_len - 1 - i] = temp;
-    }
-    
-    vga_print(size_str);
+    kprintf_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK, "Line: ");
+    kprintf("%u", current_line_num);
+    kprintf_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK, " Col: ");
+    kprintf("%u", current_col_num);
+    kprintf_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK, " Size: ");
+    kprintf("%u", editor_state.current_file->content_length);
+    vga_end_update();
 }
 
 void editor_move_cursor_up() {
@@ -335,14 +278,14 @@ void editor_move_cursor_up() {
     
     // Find the start of current line
     u16 line_start = editor_state.cursor_position;
-    while (line_start > 0 && editor_state.current_file->content[line_start - 1] != '\n') {
+    while (line_start > 0 && editor_state.content[line_start - 1] != '\n') {
         line_start--;
     }
     
     // If we're not at the first line, move to previous line
     if (line_start > 0) {
         u16 prev_line_start = line_start - 1;
-        while (prev_line_start > 0 && editor_state.current_file->content[prev_line_start - 1] != '\n') {
+        while (prev_line_start > 0 && editor_state.content[prev_line_start - 1] != '\n') {
             prev_line_start--;
         }
         
@@ -370,7 +313,7 @@ void editor_move_cursor_down() {
     // Find the end of current line
     u16 line_end = editor_state.cursor_position;
     while (line_end < editor_state.current_file->content_length && 
-           editor_state.current_file->content[line_end] != '\n') {
+           editor_state.content[line_end] != '\n') {
         line_end++;
     }
     
@@ -381,13 +324,13 @@ void editor_move_cursor_down() {
         // Find the end of next line
         u16 next_line_end = next_line_start;
         while (next_line_end < editor_state.current_file->content_length && 
-               editor_state.current_file->content[next_line_end] != '\n') {
+               editor_state.content[next_line_end] != '\n') {
             next_line_end++;
         }
         
         // Calculate cursor position on next line
         u16 current_line_start = editor_state.cursor_position;
-        while (current_line_start > 0 && editor_state.current_file->content[current_line_start - 1] != '\n') {
+        while (current_line_start > 0 && editor_state.content[current_line_start - 1] != '\n') {
             current_line_start--;
         }
         
@@ -420,23 +363,36 @@ void editor_update_view() {
     }
 }
 
+// Helper function to make room for length characters in the open file. The
+// content can only grow unlocked, and may move while it does.
+static bool editor_reserve(u16 length) {
+    if (length < editor_state.current_file->content_capacity) {
+        return true;
+    }
+    fs_unlock_content(editor_state.current_file);
+    bool reserved = fs_reserve_content(editor_state.current_file, length);
+    editor_state.content = fs_lock_content(editor_state.current_file);
+    return reserved;
+}
+
 void editor_insert_char(char c) {
     if (!editor_state.current_file) return;
     
-    if (editor_state.current_file->content_length >= MAX_FILE_SIZE - 1) {
+    if (editor_state.current_file->content_length >= MAX_FILE_SIZE - 1 ||
+        !editor_reserve(editor_state.current_file->content_length + 1)) {
         return; // No space
     }
     
     // Shift content right
-    for (u16 i = editor_state.current_file->content_length; i > editor_state.cursor_position; i--) {
-        editor_state.current_file->content[i] = editor_state.current_file->content[i - 1];
-    }
+    char* content = editor_state.content;
+    memmove(&content[editor_state.cursor_position + 1], &content[editor_state.cursor_position],
+            editor_state.current_file->content_length - editor_state.cursor_position);
     
     // Insert character
-    editor_state.current_file->content[editor_state.cursor_position] = c;
+    editor_state.content[editor_state.cursor_position] = c;
     editor_state.cursor_position++;
     editor_state.current_file->content_length++;
-    editor_state.current_file->content[editor_state.current_file->content_length] = '\0';
+    editor_state.content[editor_state.current_file->content_length] = '\0';
     editor_state.is_modified = true;
     
     editor_draw();
@@ -447,13 +403,13 @@ void editor_delete_char() {
     
     if (editor_state.cursor_position > 0) {
         // Shift content left
-        for (u16 i = editor_state.cursor_position - 1; i < editor_state.current_file->content_length; i++) {
-            editor_state.current_file->content[i] = editor_state.current_file->content[i + 1];
-        }
+        char* content = editor_state.content;
+        memmove(&content[editor_state.cursor_position - 1], &content[editor_state.cursor_position],
+                editor_state.current_file->content_length - editor_state.cursor_position + 1);
         
         editor_state.cursor_position--;
         editor_state.current_file->content_length--;
-        editor_state.current_file->content[editor_state.current_file->content_length] = '\0';
+        editor_state.content[editor_state.current_file->content_length] = '\0';
         editor_state.is_modified = true;
         editor_draw();
     }
@@ -464,12 +420,12 @@ void editor_delete_char_forward() {
     
     if (editor_state.cursor_position < editor_state.current_file->content_length) {
         // Shift content left
-        for (u16 i = editor_state.cursor_position; i < editor_state.current_file->content_length; i++) {
-            editor_state.current_file->content[i] = editor_state.current_file->content[i + 1];
-        }
+        char* content = editor_state.content;
+        memmove(&content[editor_state.cursor_position], &content[editor_state.cursor_position + 1],
+                editor_state.current_file->content_length - editor_state.cursor_position);
         
         editor_state.current_file->content_length--;
-        editor_state.current_file->content[editor_state.current_file->content_length] = '\0';
+        editor_state.content[editor_state.current_file->content_length] = '\0';
         editor_state.is_modified = true;
         editor_draw();
     }
@@ -490,8 +446,12 @@ bool editor_save() {
 }
 
 void editor_exit() {
+    if (editor_state.current_file) {
+        fs_unlock_content(editor_state.current_file);
+    }
     editor_state.is_active = false;
     editor_state.current_file = 0;
+    editor_state.content = 0;
     vga_clear();
     vga_set_cursor(0, 0); // Move cursor to top-left corner
     vga_enable_cursor(14, 15); // Re-enable hardware cursor for shell
@@ -525,7 +485,7 @@ void editor_update_scroll() {
     u16 current_line = 0;
     u16 pos = 0;
     while (pos < editor_state.cursor_position && pos < editor_state.current_file->content_length) {
-        if (editor_state.current_file->content[pos] == '\n') {
+        if (editor_state.content[pos] == '\n') {
             current_line++;
         }
         pos++;
@@ -545,7 +505,7 @@ u16 editor_count_lines() {
     
     u16 lines = 1; // At least one line
     for (u16 i = 0; i < editor_state.current_file->content_length; i++) {
-        if (editor_state.current_file->content[i] == '\n') {
+        if (editor_state.content[i] == '\n') {
             lines++;
         }
     }
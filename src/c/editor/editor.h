@@ -15,6 +15,7 @@ struct keyboard_event;
 // Editor state
 typedef struct {
     file_t* current_file;
+    char* content;        // Content of current_file, locked while it is open
     u16 cursor_position;
     u16 start_position;  // First visible position
     u16 scroll_offset;    // Vertical scroll offset (in lines)
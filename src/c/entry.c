@@ -1,4 +1,7 @@
 #include "kernel/kernel.h"
+#include "kernel/fpu.h"
+#include "kernel/work_queue.h"
+#include "libk/mem.h"
 #include "drivers/keyboard/keyboard.h"
 #include "drivers/timer/timer.h"
 #include "drivers/serial_port/serial_port.h"
@@ -7,6 +10,13 @@
 #include "shell/commands.h"
 #include "screensaver/screensaver.h"
 #include "memory/memory.h"
+#include "memory/pmm.h"
+#include "memory/paging.h"
+#include "memory/vm.h"
+#include "kernel/multiboot.h"
+
+// Initial size of the kernel heap, it grows from the frame allocator on demand
+#define KERNEL_HEAP_INITIAL_SIZE 0x80000
 
 void exception_handler(u32 interrupt, u32 error, char *message) {
     serial_log(LOG_ERROR, message);
@@ -17,10 +27,13 @@ void init_kernel() {
     init_idt();
     init_exception_handlers();
     init_interrupt_handlers();
-    register_timer_interrupt_handler();
+    tsc_init();
+    register_timer_interrupt_handler(TIMER_DEFAULT_FREQUENCY);
     register_keyboard_interrupt_handler();
     configure_default_serial_port();
     set_exception_handler(exception_handler);
+    fpu_init();
+    libk_init();
     enable_interrupts();
 }
 
@@ -29,10 +42,8 @@ void init_kernel() {
  * the first line 20th column, position = 80 will place in the first column of the second line.
  */
 void put_cursor(unsigned short pos) {
-    out(0x3D4, 14);
-    out(0x3D5, ((pos >> 8) & 0x00FF));
-    out(0x3D4, 15);
-    out(0x3D5, pos & 0x00FF);
+    outw(0x3D4, (pos & 0xFF00) | 14); // Register index in the low byte, its value in the high byte
+    outw(0x3D4, (pos << 8) | 15);
 }
 
 /**
@@ -43,25 +54,55 @@ _Noreturn void halt_loop() {
     while (1) { halt(); }
 }
 
-void key_handler(struct keyboard_event event) {
+/**
+ * Runs from the work queue, with the key event packed into the argument by key_handler.
+ */
+void handle_key_work(u32 packed_event) {
+    struct keyboard_event event;
+    event.key = packed_event & 0xFF;
+    event.type = (packed_event >> 8) & 0xFF;
+    event.key_character = (char)(packed_event >> 16);
     shell_handle_keyboard(event);
 }
 
-void timer_tick_handler() {
-    screensaver_timer_tick();
-    screensaver_check_inactivity();
+/**
+ * Called in the keyboard interrupt. The shell may redraw the screen or run a
+ * whole command for a key, so that is left to the main loop.
+ */
+void key_handler(struct keyboard_event event) {
+    work_queue_push(handle_key_work, (event.key & 0xFF) | (event.type & 0xFF) << 8 | (u8)event.key_character << 16);
+}
+
+/**
+ * Builds the frame allocator from the bootloader memory map and starts the kernel
+ * heap in the lowest free frames, so it has room to grow upwards in place.
+ */
+void init_memory(multiboot_info_t* multiboot_info) {
+    pmm_init(multiboot_info);
+
+    u32 heap_start = pmm_alloc_frames_low(KERNEL_HEAP_INITIAL_SIZE / PMM_FRAME_SIZE);
+    if (heap_start == 0) {
+        serial_log(LOG_ERROR, "Not enough memory for the kernel heap");
+        halt_loop();
+    }
+    memory_init(PHYS_TO_VIRT(heap_start), KERNEL_HEAP_INITIAL_SIZE);
+    vm_init();
 }
 
 /**
- * This is where the bootloader transfers control to.
+ * This is where boot.asm transfers control to, with paging on and running in the higher half.
+ * The argument is the multiboot information structure left by the bootloader in ebx
+ * (through the direct map).
  */
-void kernel_entry() {
+void kernel_entry(multiboot_info_t* multiboot_info) {
+    paging_init();
     init_kernel();
     keyboard_set_handler(key_handler);
-    timer_set_handler(timer_tick_handler);
 
-    // Initialize memory manager (heap starts at 1MB, size 512KB)
-    memory_init(0x100000, 0x80000);
+    init_memory(multiboot_info);
+    if (!vga_enable_write_combining()) {
+        serial_log(LOG_WARNING, "No PAT or MTRR, the framebuffer stays uncached");
+    }
     
     // Initialize shell system
     shell_init();
@@ -1,58 +1,21 @@
 #include "filesystem/filesystem.h"
 #include "drivers/vga/vga.h"
 #include "shell/shell.h"
+#include "memory/slab.h"
+#include "libk/mem.h"
+#include "libk/string.h"
+#include "libk/printf.h"
 
 static filesystem_t filesystem;
-
-// Helper function to compare strings
-static bool str_equals(const char* str1, const char* str2) {
-    while (*str1 && *str2) {
-        if (*str1 != *str2) return false;
-        str1++;
-        str2++;
-    }
-    return *str1 == *str2;
-}
-
-// Helper function to copy string
-static void str_copy(char* dest, const char* src) {
-    while (*src) {
-        *dest = *src;
-        dest++;
-        src++;
-    }
-    *dest = '\0';
-}
-
-// Helper function to get string length
-static u16 str_length(const char* str) {
-    u16 len = 0;
-    while (*str) {
-        len++;
-        str++;
-    }
-    return len;
-}
-
-// Helper function to convert string to number
-static u16 str_to_number(const char* str) {
-    u16 result = 0;
-    while (*str >= '0' && *str <= '9') {
-        result = result * 10 + (*str - '0');
-        str++;
-    }
-    return result;
-}
+static kmem_cache_t* file_cache;
 
 void fs_init() {
     filesystem.file_count = 0;
+    file_cache = kmem_cache_create("file_t", sizeof(file_t), 0, 0);
     
-    // Initialize all files as non-existent
+    // Initialize all file slots as empty
     for (u8 i = 0; i < MAX_FILES; i++) {
-        filesystem.files[i].exists = false;
-        filesystem.files[i].name[0] = '\0';
-        filesystem.files[i].content[0] = '\0';
-        filesystem.files[i].content_length = 0;
+        filesystem.files[i] = 0;
     }
 }
 
@@ -60,6 +23,9 @@ bool fs_create_file(const char* filename) {
     if (filesystem.file_count >= MAX_FILES) {
         return false; // No space for new files
     }
+    if (strnlen(filename, MAX_FILENAME_LENGTH) == MAX_FILENAME_LENGTH) {
+        return false; // Name does not fit
+    }
     
     // Check if file already exists
     if (fs_file_exists(filename)) {
@@ -68,12 +34,24 @@ bool fs_create_file(const char* filename) {
     
     // Find empty slot
     for (u8 i = 0; i < MAX_FILES; i++) {
-        if (!filesystem.files[i].exists) {
-            str_copy(filesystem.files[i].name, filename);
-            filesystem.files[i].exists = true;
-            filesystem.files[i].content[0] = '\0';
-            filesystem.files[i].content_length = 0;
-            filesystem.files[i].is_read_only = false;
+        if (!filesystem.files[i]) {
+            file_t* file = kmem_cache_alloc(file_cache);
+            if (!file) {
+                return false; // Out of memory
+            }
+            file->content = halloc(FILE_CONTENT_INITIAL_SIZE);
+            if (!file->content) {
+                kmem_cache_free(file_cache, file);
+                return false; // Out of memory
+            }
+            strlcpy(file->name, filename, MAX_FILENAME_LENGTH);
+            file->exists = true;
+            fs_lock_content(file)[0] = '\0';
+            fs_unlock_content(file);
+            file->content_capacity = FILE_CONTENT_INITIAL_SIZE;
+            file->content_length = 0;
+            file->is_read_only = false;
+            filesystem.files[i] = file;
             filesystem.file_count++;
             return true;
         }
@@ -84,11 +62,11 @@ bool fs_create_file(const char* filename) {
 
 bool fs_delete_file(const char* filename) {
     for (u8 i = 0; i < MAX_FILES; i++) {
-        if (filesystem.files[i].exists && str_equals(filesystem.files[i].name, filename)) {
-            filesystem.files[i].exists = false;
-            filesystem.files[i].name[0] = '\0';
-            filesystem.files[i].content[0] = '\0';
-            filesystem.files[i].content_length = 0;
+        if (filesystem.files[i] && strcmp(filesystem.files[i]->name, filename) == 0) {
+            filesystem.files[i]->exists = false;
+            hfree(filesystem.files[i]->content);
+            kmem_cache_free(file_cache, filesystem.files[i]);
+            filesystem.files[i] = 0;
             filesystem.file_count--;
             return true;
         }
@@ -98,7 +76,7 @@ bool fs_delete_file(const char* filename) {
 
 bool fs_file_exists(const char* filename) {
     for (u8 i = 0; i < MAX_FILES; i++) {
-        if (filesystem.files[i].exists && str_equals(filesystem.files[i].name, filename)) {
+        if (filesystem.files[i] && strcmp(filesystem.files[i]->name, filename) == 0) {
             return true;
         }
     }
@@ -107,13 +85,43 @@ bool fs_file_exists(const char* filename) {
 
 file_t* fs_get_file(const char* filename) {
     for (u8 i = 0; i < MAX_FILES; i++) {
-        if (filesystem.files[i].exists && str_equals(filesystem.files[i].name, filename)) {
-            return &filesystem.files[i];
+        if (filesystem.files[i] && strcmp(filesystem.files[i]->name, filename) == 0) {
+            return filesystem.files[i];
         }
     }
     return 0;
 }
 
+char* fs_lock_content(file_t* file) {
+    return hlock(file->content);
+}
+
+void fs_unlock_content(file_t* file) {
+    hunlock(file->content);
+}
+
+bool fs_reserve_content(file_t* file, u16 length) {
+    if (length < file->content_capacity) {
+        return true;
+    }
+    if (length >= MAX_FILE_SIZE) {
+        return false;
+    }
+
+    u16 capacity = file->content_capacity;
+    while (capacity <= length) {
+        capacity *= 2;
+    }
+    if (capacity > MAX_FILE_SIZE) {
+        capacity = MAX_FILE_SIZE;
+    }
+    if (!hrealloc(file->content, capacity)) {
+        return false;
+    }
+    file->content_capacity = capacity;
+    return true;
+}
+
 void fs_list_files() {
     vga_print_color("Files in memory:\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
     vga_print_color("===============\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
@@ -123,31 +131,10 @@ void fs_list_files() {
     }
     
     for (u8 i = 0; i < MAX_FILES; i++) {
-        if (filesystem.files[i].exists) {
+        if (filesystem.files[i]) {
             vga_print_color(" ", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
-            vga_print(filesystem.files[i].name);
-            vga_print_color(" (", VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
-            // Print file size
-            char size_str[8];
-            u16 size = filesystem.files[i].content_length;
-            u8 pos = 0;
-            if (size == 0) {
-                size_str[pos++] = '0';
-            } else {
-                while (size > 0) {
-                    size_str[pos++] = '0' + (size % 10);
-                    size /= 10;
-                }
-            }
-            size_str[pos] = '\0';
-            // Reverse the string
-            for (u8 j = 0; j < pos / 2; j++) {
-                char temp = size_str[j];
-                size_str[j] = size_str[pos - 1 - j];
-                size_str[pos - 1 - j] = temp;
-            }
-            vga_print(size_str);
-            vga_print_color(" chars)\n", VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
+            vga_print(filesystem.files[i]->name);
+            kprintf_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK, " (%u chars)\n", filesystem.files[i]->content_length);
         }
     }
 }
@@ -158,12 +145,13 @@ bool fs_write_file(const char* filename, const char* content) {
         return false;
     }
     
-    u16 content_len = str_length(content);
-    if (content_len >= MAX_FILE_SIZE) {
+    u16 content_len = strnlen(content, MAX_FILE_SIZE);
+    if (content_len >= MAX_FILE_SIZE || !fs_reserve_content(file, content_len)) {
         return false; // Content too large
     }
     
-    str_copy(file->content, content);
+    memcpy(fs_lock_content(file), content, content_len + 1);
+    fs_unlock_content(file);
     file->content_length = content_len;
     return true;
 }
@@ -179,9 +167,8 @@ bool fs_read_file(const char* filename, char* buffer, u16 buffer_size) {
         copy_len = buffer_size - 1;
     }
     
-    for (u16 i = 0; i < copy_len; i++) {
-        buffer[i] = file->content[i];
-    }
+    memcpy(buffer, fs_lock_content(file), copy_len);
+    fs_unlock_content(file);
     buffer[copy_len] = '\0';
     return true;
 }
@@ -192,18 +179,18 @@ bool fs_append_file(const char* filename, const char* content) {
         return false;
     }
     
-    u16 content_len = str_length(content);
+    u16 content_len = strnlen(content, MAX_FILE_SIZE);
     u16 new_length = file->content_length + content_len;
     
-    if (new_length >= MAX_FILE_SIZE) {
+    if (new_length >= MAX_FILE_SIZE || !fs_reserve_content(file, new_length)) {
         return false; // Would exceed max size
     }
     
     // Append content
-    for (u16 i = 0; i < content_len; i++) {
-        file->content[file->content_length + i] = content[i];
-    }
-    file->content[new_length] = '\0';
+    char* data = fs_lock_content(file);
+    memcpy(&data[file->content_length], content, content_len);
+    data[new_length] = '\0';
+    fs_unlock_content(file);
     file->content_length = new_length;
     return true;
 }
@@ -214,24 +201,22 @@ bool fs_insert_at_position(const char* filename, const char* content, u16 positi
         return false;
     }
     
-    u16 content_len = str_length(content);
+    u16 content_len = strnlen(content, MAX_FILE_SIZE);
     u16 new_length = file->content_length + content_len;
     
-    if (position > file->content_length || new_length >= MAX_FILE_SIZE) {
+    if (position > file->content_length || new_length >= MAX_FILE_SIZE || !fs_reserve_content(file, new_length)) {
         return false;
     }
     
     // Shift existing content right
-    for (u16 i = file->content_length; i > position; i--) {
-        file->content[i + content_len - 1] = file->content[i - 1];
-    }
+    char* data = fs_lock_content(file);
+    memmove(&data[position + content_len], &data[position], file->content_length - position);
     
     // Insert new content
-    for (u16 i = 0; i < content_len; i++) {
-        file->content[position + i] = content[i];
-    }
+    memcpy(&data[position], content, content_len);
     
-    file->content[new_length] = '\0';
+    data[new_length] = '\0';
+    fs_unlock_content(file);
     file->content_length = new_length;
     return true;
 }
@@ -251,12 +236,12 @@ bool fs_delete_from_position(const char* filename, u16 position, u16 length) {
     }
     
     // Shift content left
-    for (u16 i = position; i < file->content_length - length; i++) {
-        file->content[i] = file->content[i + length];
-    }
+    char* data = fs_lock_content(file);
+    memmove(&data[position], &data[position + length], file->content_length - position - length);
     
     file->content_length -= length;
-    file->content[file->content_length] = '\0';
+    data[file->content_length] = '\0';
+    fs_unlock_content(file);
     return true;
 }
 
@@ -266,51 +251,49 @@ bool fs_replace_content(const char* filename, const char* old_text, const char*
         return false;
     }
     
-    u16 old_len = str_length(old_text);
-    u16 new_len = str_length(new_text);
+    u16 old_len = strnlen(old_text, MAX_FILE_SIZE);
+    u16 new_len = strnlen(new_text, MAX_FILE_SIZE);
     
     // Find first occurrence of old_text
-    for (u16 i = 0; i <= file->content_length - old_len; i++) {
-        bool found = true;
+    char* data = fs_lock_content(file);
+    bool found = false;
+    u16 i;
+    for (i = 0; i <= file->content_length - old_len; i++) {
+        found = true;
         for (u16 j = 0; j < old_len; j++) {
-            if (file->content[i + j] != old_text[j]) {
+            if (data[i + j] != old_text[j]) {
                 found = false;
                 break;
             }
         }
-        
         if (found) {
-            // Calculate new length
-            u16 new_content_length = file->content_length - old_len + new_len;
-            if (new_content_length >= MAX_FILE_SIZE) {
-                return false;
-            }
-            
-            // Shift content if new text is longer
-            if (new_len > old_len) {
-                for (u16 k = file->content_length; k > i + old_len; k--) {
-                    file->content[k + new_len - old_len - 1] = file->content[k - 1];
-                }
-            }
-            // Shift content if new text is shorter
-            else if (new_len < old_len) {
-                for (u16 k = i + old_len; k < file->content_length; k++) {
-                    file->content[k - old_len + new_len] = file->content[k];
-                }
-            }
-            
-            // Insert new text
-            for (u16 j = 0; j < new_len; j++) {
-                file->content[i + j] = new_text[j];
-            }
-            
-            file->content_length = new_content_length;
-            file->content[file->content_length] = '\0';
-            return true;
+            break;
         }
     }
+    fs_unlock_content(file);
+    if (!found) {
+        return false; // old_text not found
+    }
     
-    return false; // old_text not found
+    // Calculate new length, the content may have to grow (and move) for it
+    u16 new_content_length = file->content_length - old_len + new_len;
+    if (new_content_length >= MAX_FILE_SIZE || !fs_reserve_content(file, new_content_length)) {
+        return false;
+    }
+    
+    // Shift the rest of the content to where the new text ends
+    data = fs_lock_content(file);
+    if (new_len != old_len) {
+        memmove(&data[i + new_len], &data[i + old_len], file->content_length - i - old_len);
+    }
+    
+    // Insert new text
+    memcpy(&data[i], new_text, new_len);
+    
+    file->content_length = new_content_length;
+    data[file->content_length] = '\0';
+    fs_unlock_content(file);
+    return true;
 }
 
 u16 fs_get_file_size(const char* filename) {
@@ -327,7 +310,8 @@ bool fs_clear_file(const char* filename) {
         return false;
     }
     
-    file->content[0] = '\0';
+    fs_lock_content(file)[0] = '\0';
+    fs_unlock_content(file);
     file->content_length = 0;
     return true;
 }
@@ -2,25 +2,29 @@
 #define FILESYSTEM_H
 
 #include "kernel/kernel.h"
+#include "memory/memory.h"
 
 #define MAX_FILES 10
 #define MAX_FILENAME_LENGTH 32
 #define MAX_FILE_SIZE 2000
 #define MAX_FILE_CONTENT_LINES 25
 #define MAX_LINE_LENGTH 80
+#define FILE_CONTENT_INITIAL_SIZE 64 // Content blocks start this small and double as files grow
 
-// File structure
+// File structure. The content is a movable heap block, so memory_defragment
+// can slide it around while nobody has it locked (see fs_lock_content).
 typedef struct {
     char name[MAX_FILENAME_LENGTH];
-    char content[MAX_FILE_SIZE];
+    handle_t content;            // Always terminated, content_capacity bytes
+    u16 content_capacity;
     u16 content_length;
     bool exists;
     bool is_read_only;
 } file_t;
 
-// File system structure
+// File system structure (file records come from the file_t object cache)
 typedef struct {
-    file_t files[MAX_FILES];
+    file_t* files[MAX_FILES];
     u8 file_count;
 } filesystem_t;
 
@@ -39,6 +43,15 @@ bool fs_file_exists(const char* filename);
 // Get file by name
 file_t* fs_get_file(const char* filename);
 
+// Lock the content of a file in place and get it. Locks nest, each needs a
+// matching fs_unlock_content, and the content cannot grow while locked.
+char* fs_lock_content(file_t* file);
+void fs_unlock_content(file_t* file);
+
+// Make room for length characters and the terminator, doubling the content
+// block as needed (up to MAX_FILE_SIZE). Fails if it has to grow while locked.
+bool fs_reserve_content(file_t* file, u16 length);
+
 // List all files
 void fs_list_files();
 
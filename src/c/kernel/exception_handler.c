@@ -1,6 +1,10 @@
 #include "kernel.h"
+#include "kernel/fpu.h"
+#include "memory/vm.h"
 
 #define EXCEPTION_GATE_TYPE_ATTRIBUTES 0x8F
+#define EXCEPTION_DEVICE_NOT_AVAILABLE 7
+#define EXCEPTION_PAGE_FAULT 14
 
 extern void eh0();
 extern void eh1();
@@ -129,10 +133,18 @@ void set_exception_handler(void (*handler)(u32 interrupt, u32 error, char *messa
 }
 
 /**
- * Called from ASM. At this point there is nothing that happens in case of exception.
+ * Called from ASM. Page faults on committed virtual memory and the first FPU/SSE
+ * instruction of a kernel_fpu_begin section are resolved and the faulting instruction
+ * restarted, any other exception is reported and stops the kernel.
  */
 void kernel_exception_handler(struct eh_stack_state *r) {
     if (r->interrupt < 32) {
+        if (r->interrupt == EXCEPTION_DEVICE_NOT_AVAILABLE && fpu_handle_device_not_available()) {
+            return;
+        }
+        if (r->interrupt == EXCEPTION_PAGE_FAULT && vm_handle_page_fault(read_cr2(), r->error)) {
+            return;
+        }
         if (custom_handler != 0) {
             custom_handler(r->interrupt, r->error, exception_messages[r->interrupt]);
         }
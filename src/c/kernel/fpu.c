@@ -0,0 +1,83 @@
+#include "kernel/fpu.h"
+
+#define FPU_CPUID_EDX_FXSR (1 << 24)
+#define FPU_CPUID_EDX_SSE (1 << 25)
+#define FPU_CPUID_EDX_SSE2 (1 << 26)
+#define FPU_CPUID_ECX_SSE4_2 (1 << 20)
+
+static u32 features;
+static bool has_fxsr;
+static u32 depth;                            // Sections open, the innermost one is the current one
+static u32 owner;                            // Section whose values are in the registers, 0 if none
+static bool saved[FPU_MAX_DEPTH + 1];        // Registers of the section at this depth are in its save area
+static u8 save_areas[FPU_MAX_DEPTH + 1][FPU_SAVE_AREA_SIZE] __attribute__((aligned(16)));
+
+void fpu_init() {
+    u32 eax, ebx, ecx, edx;
+    read_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    // enable_fpu only turns SSE on together with fxsave/fxrstor
+    has_fxsr = (edx & FPU_CPUID_EDX_FXSR) != 0;
+    features = 0;
+    if (has_fxsr && (edx & FPU_CPUID_EDX_SSE)) {
+        features |= FPU_FEATURE_SSE;
+        if (edx & FPU_CPUID_EDX_SSE2) features |= FPU_FEATURE_SSE2;
+        if (ecx & FPU_CPUID_ECX_SSE4_2) features |= FPU_FEATURE_SSE4_2;
+    }
+    depth = 0;
+    owner = 0;
+}
+
+bool fpu_has_feature(u32 feature) {
+    return (features & feature) == feature;
+}
+
+void kernel_fpu_begin() {
+    u32 flags = save_and_disable_interrupts();
+    depth++;
+    if (owner == 0) {
+        owner = depth;
+        clear_task_switched();
+    } else {
+        // An interrupted section's values are still live, they are saved on first use
+        set_task_switched();
+    }
+    restore_interrupts(flags);
+}
+
+void kernel_fpu_end() {
+    u32 flags = save_and_disable_interrupts();
+    if (owner == depth) {
+        owner = 0; // What this section left in the registers is of no use to anyone
+    }
+    depth--;
+
+    if (depth > 0 && saved[depth]) {
+        // A nested section took the registers from this one, give them back
+        clear_task_switched();
+        restore_fpu_state(save_areas[depth], has_fxsr);
+        saved[depth] = false;
+        owner = depth;
+    }
+
+    if (depth > 0 && owner == depth) {
+        clear_task_switched();
+    } else {
+        set_task_switched(); // Outside sections or registers not ours: trap on use
+    }
+    restore_interrupts(flags);
+}
+
+bool fpu_handle_device_not_available() {
+    if (depth == 0 || depth > FPU_MAX_DEPTH) {
+        return false;
+    }
+    // Runs with interrupts disabled (see ex_handlers.asm)
+    clear_task_switched();
+    if (owner != 0 && owner != depth) {
+        save_fpu_state(save_areas[owner], has_fxsr);
+        saved[owner] = true;
+    }
+    owner = depth;
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include "kernel/kernel.h"
+
+// Sections nest when an interrupt or exception handler opens one while the
+// interrupted code has one open, one level for the main code and each handler
+#define FPU_MAX_DEPTH 4
+#define FPU_SAVE_AREA_SIZE 512       // fxsave area, fnsave needs 108 bytes of it
+
+// SIMD extensions usable inside sections, see fpu_has_feature
+#define FPU_FEATURE_SSE 0x1
+#define FPU_FEATURE_SSE2 0x2
+#define FPU_FEATURE_SSE4_2 0x4
+
+// Detect the SIMD extensions boot.asm enabled (enable_fpu in checks.asm)
+void fpu_init();
+
+// Check whether a FPU_FEATURE_* extension can be used
+bool fpu_has_feature(u32 feature);
+
+// Open a section in which FPU and SSE registers may be used. Kernel code is
+// compiled without SSE, functions using it need __attribute__((target("sse2")))
+// (or similar) and must only run inside a section. Registers are not saved
+// here: only when a nested section actually executes an FPU/SSE instruction
+// are the interrupted section's registers saved (on the #NM trap), so
+// handlers that don't use SIMD pay nothing.
+void kernel_fpu_begin();
+
+// Close the section opened by the matching kernel_fpu_begin
+void kernel_fpu_end();
+
+// Called for Device Not Available exceptions (vector 7), which CR0.TS raises
+// on the first FPU/SSE instruction of a section. Returns false for FPU use
+// outside any section, which is a bug.
+bool fpu_handle_device_not_available();
+
+#endif
@@ -1,4 +1,5 @@
 #include "kernel.h"
+#include "libk/mem.h"
 
 #define IDT_SIZE 512
 
@@ -31,14 +32,9 @@ void set_idt_entry(u8 interrupt, u32 base, u16 code_selector, u8 attributes) {
     idt[interrupt].field5_attributes = attributes;
 }
 
-void zero_memory(void *dest, u32 count) {
-    u8 *temp = (u8 *) dest;
-    for (; count != 0; count--) *temp++ = 0;
-}
-
 void init_idt() {
     idt_ptr.limit = (sizeof(struct idt_entry) * IDT_SIZE) - 1;
     idt_ptr.base = (u32) &idt; // (Note: x32)
-    zero_memory(&idt, sizeof(struct idt_entry) * IDT_SIZE);
+    memset(&idt, 0, sizeof(struct idt_entry) * IDT_SIZE);
     load_idt(&idt_ptr);
 }
@@ -1,4 +1,5 @@
 #include "kernel.h"
+#include "libk/mem.h"
 
 #define INTERRUPT_GATE_TYPE_ATTRIBUTES 0x8E
 #define MASTER_PIC_COMMAND_PORT 0x20
@@ -8,7 +9,11 @@
 #define MASTER_INTERRUPT_OFFSET 32
 #define SLAVE_INTERRUPT_OFFSET (MASTER_INTERRUPT_OFFSET + 8)
 #define END_OF_INTERRUPT_COMMAND 0x20
+#define READ_IN_SERVICE_COMMAND 0x0B  // OCW3, the next read of the command port returns the ISR
 #define MODE_8086 0x01
+#define SPURIOUS_LINE_BIT 0x80        // IRQ 7 on either PIC, where it signals spurious interrupts
+#define BENCHMARK_LEGACY_INTERRUPT 0xF0 // Vectors reserved for the benchmark stubs, clear of 0x80 (the usual syscall vector)
+#define BENCHMARK_LEAN_INTERRUPT 0xF1
 
 extern void irq0();
 extern void irq1();
@@ -26,11 +31,36 @@ extern void irq12();
 extern void irq13();
 extern void irq14();
 extern void irq15();
+extern void irq_bench_legacy();
+extern void irq_bench_lean();
 
-void *irq_handlers[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+static interrupt_action_t* irq_actions[INTERRUPT_LINES];
 
-void set_interrupt_handler(u32 interrupt, void (*handler)(u32 interrupt)) {
-    irq_handlers[interrupt] = handler;
+static interrupt_stats_t irq_stats[INTERRUPT_LINES];
+
+void add_interrupt_handler(u32 interrupt, interrupt_action_t* action) {
+    u32 flags = save_and_disable_interrupts();
+    interrupt_action_t** link = &irq_actions[interrupt];
+    while (*link) {
+        link = &(*link)->next;
+    }
+    action->next = 0;
+    *link = action;
+    restore_interrupts(flags);
+}
+
+bool remove_interrupt_handler(u32 interrupt, interrupt_action_t* action) {
+    u32 flags = save_and_disable_interrupts();
+    interrupt_action_t** link = &irq_actions[interrupt];
+    while (*link && *link != action) {
+        link = &(*link)->next;
+    }
+    bool found = *link != 0;
+    if (found) {
+        *link = action->next;
+    }
+    restore_interrupts(flags);
+    return found;
 }
 
 void idt_set_interrupt_handler(u8 interrupt, void (*handler_ptr)()) {
@@ -73,31 +103,113 @@ void init_interrupt_handlers() {
     idt_set_interrupt_handler(SLAVE_INTERRUPT_OFFSET + 5, irq13);
     idt_set_interrupt_handler(SLAVE_INTERRUPT_OFFSET + 6, irq14);
     idt_set_interrupt_handler(SLAVE_INTERRUPT_OFFSET + 7, irq15);
+    idt_set_interrupt_handler(BENCHMARK_LEGACY_INTERRUPT, irq_bench_legacy);
+    idt_set_interrupt_handler(BENCHMARK_LEAN_INTERRUPT, irq_bench_lean);
 }
 
-struct irq_stack_state {
-    u32 gs, fs, es, ds;                         // pushed directly by common stub
-    u32 edi, esi, ebp, esp, ebx, edx, ecx, eax; // pusha in common stub
-    u32 interrupt;                              // pushed by concrete routine
-    u32 eip, cs, eflags, useresp, ss;           // automatically pushed by cpu
-};
+// Helper function to count a duration in a histogram, by powers of two
+static inline void count_in_histogram(u32* histogram, u32 cycles) {
+    u32 bucket = 31 - __builtin_clz(cycles | 1);
+    bucket = bucket < INTERRUPT_HISTOGRAM_SHIFT ? 0 : bucket - INTERRUPT_HISTOGRAM_SHIFT + 1;
+    histogram[bucket < INTERRUPT_HISTOGRAM_BUCKETS ? bucket : INTERRUPT_HISTOGRAM_BUCKETS - 1]++;
+}
+
+// Helper function to clamp a TSC difference for the 32-bit statistics
+static inline u32 clamp_cycles(u64 cycles) {
+    return cycles > 0xFFFFFFFF ? 0xFFFFFFFF : (u32)cycles;
+}
+
+// Helper function to check whether an interrupt on line 7 of a PIC is real.
+// When a request goes away before the CPU acknowledges it, the PIC still
+// delivers its lowest priority line, but does not mark it in service.
+static bool is_spurious(u16 command_port) {
+    out(command_port, READ_IN_SERVICE_COMMAND);
+    return !(in(command_port) & SPURIOUS_LINE_BIT);
+}
 
 /**
- * Delegates execution of the interrupt to the registered routine (see irq_set_handler).
- * Will be called by ASM code whenever interrupt occurs (see ex_handlers.asm).
+ * Delegates execution of the interrupt to the chain of its line (see add_interrupt_handler).
+ * Will be called by ASM code with the vector whenever interrupt occurs (see int_handlers.asm).
  */
-void kernel_interrupt_handler(struct irq_stack_state *stack_ptr) {
-    // Delegate handling to the function in case it's registered
-    void (*handler)(u32 interrupt) = irq_handlers[stack_ptr->interrupt - MASTER_INTERRUPT_OFFSET];
-    if (handler) {
-        handler(stack_ptr->interrupt);
+void kernel_interrupt_handler(u32 interrupt) {
+    const u32 line = interrupt - MASTER_INTERRUPT_OFFSET;
+    interrupt_stats_t* stats = &irq_stats[line];
+    const bool timed = tsc_get_khz() != 0;
+    const u64 entry = timed ? cycles_now() : 0;
+
+    // Spurious interrupts get no EOI from the PIC that raised them, a spurious
+    // one from the slave still needs one for the cascade line on the master
+    if (line == 7 && is_spurious(MASTER_PIC_COMMAND_PORT)) {
+        stats->spurious++;
+        return;
+    }
+    if (line == 15 && is_spurious(SLAVE_PIC_COMMAND_PORT)) {
+        stats->spurious++;
+        out(MASTER_PIC_COMMAND_PORT, END_OF_INTERRUPT_COMMAND);
+        return;
     }
 
+    // Delegate handling to the chain, up to the handler whose device raised it
+    const interrupt_action_t* action = irq_actions[line];
+    while (action && !action->handler(interrupt)) {
+        action = action->next;
+    }
+    if (!action) {
+        stats->unclaimed++;
+    }
+    const u64 handled = timed ? cycles_now() : 0;
+
     // send EOI to slave only if it's a slaves' interrupt
-    if (stack_ptr->interrupt >= SLAVE_INTERRUPT_OFFSET) {
+    if (interrupt >= SLAVE_INTERRUPT_OFFSET) {
         out(SLAVE_PIC_COMMAND_PORT, END_OF_INTERRUPT_COMMAND);
     }
 
     // always send EOI to master
     out(MASTER_PIC_COMMAND_PORT, END_OF_INTERRUPT_COMMAND);
+
+    stats->count++;
+    if (timed) {
+        const u32 handler_cycles = clamp_cycles(handled - entry);
+        const u32 eoi_cycles = clamp_cycles(cycles_now() - entry);
+        stats->handler_cycles += handler_cycles;
+        if (handler_cycles > stats->max_handler_cycles) {
+            stats->max_handler_cycles = handler_cycles;
+        }
+        if (eoi_cycles > stats->max_eoi_cycles) {
+            stats->max_eoi_cycles = eoi_cycles;
+        }
+        count_in_histogram(stats->handler_histogram, handler_cycles);
+        count_in_histogram(stats->eoi_histogram, eoi_cycles);
+    }
+}
+
+void get_interrupt_stats(u32 interrupt, interrupt_stats_t* stats) {
+    u32 flags = save_and_disable_interrupts();
+    *stats = irq_stats[interrupt];
+    restore_interrupts(flags);
+}
+
+void reset_interrupt_stats() {
+    u32 flags = save_and_disable_interrupts();
+    memset(irq_stats, 0, sizeof(irq_stats));
+    restore_interrupts(flags);
+}
+
+bool benchmark_interrupt_entry(u32 rounds, u32* legacy_cycles, u32* lean_cycles) {
+    if (tsc_get_khz() == 0) {
+        return false;
+    }
+
+    u64 start = cycles_now();
+    for (u32 round = 0; round < rounds; round++) {
+        __asm__ volatile("int %0" : : "i"(BENCHMARK_LEGACY_INTERRUPT) : "memory");
+    }
+    *legacy_cycles = (u32)div_u64(cycles_now() - start, rounds, 0);
+
+    start = cycles_now();
+    for (u32 round = 0; round < rounds; round++) {
+        __asm__ volatile("int %0" : : "i"(BENCHMARK_LEAN_INTERRUPT) : "memory");
+    }
+    *lean_cycles = (u32)div_u64(cycles_now() - start, rounds, 0);
+    return true;
 }
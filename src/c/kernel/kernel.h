@@ -4,6 +4,7 @@
 typedef unsigned char u8;
 typedef unsigned short u16;
 typedef unsigned int u32;
+typedef unsigned long long u64;
 typedef unsigned char bool;
 
 #define true 1
@@ -13,16 +14,185 @@ typedef unsigned char bool;
 #define KERNEL_CODE_SEGMENT 0x08
 #define INTERRUPT_TIMER 0
 #define INTERRUPT_KEYBOARD 1
+#define INTERRUPT_LINES 16
+#define INTERRUPT_HISTOGRAM_BUCKETS 16
+#define INTERRUPT_HISTOGRAM_SHIFT 10     // Bucket n counts durations below 2^(10 + n) TSC cycles not counted before it, the last all longer ones
+
+// The kernel is linked at KERNEL_VIRTUAL_BASE + its physical address, and all RAM
+// below KERNEL_DIRECT_MAP_SIZE is mapped there as well (see boot.asm and link.ld).
+// Physical addresses in that range are accessed through PHYS_TO_VIRT.
+#ifndef KERNEL_VIRTUAL_BASE
+#define KERNEL_VIRTUAL_BASE 0xC0000000
+#endif
+#define KERNEL_DIRECT_MAP_SIZE 0x30000000
+#define PHYS_TO_VIRT(address) ((u32)(address) + KERNEL_VIRTUAL_BASE)
+#define VIRT_TO_PHYS(address) ((u32)(address) - KERNEL_VIRTUAL_BASE)
 
 /**
  * Reads a single byte from the given port.
+ * Port accessors are inlined, a call into assembly would cost more than the
+ * instruction itself. The memory clobber keeps them ordered with memory
+ * accesses, e.g. a buffer filled before the port write that hands it over.
  */
-extern u8 in(u16 port);
+static inline u8 in(u16 port) {
+    u8 byte;
+    __asm__ volatile("inb %1, %0" : "=a"(byte) : "Nd"(port) : "memory");
+    return byte;
+}
 
 /**
  * Writes the given byte to the given port.
  */
-extern void out(u16 port, u8 byte);
+static inline void out(u16 port, u8 byte) {
+    __asm__ volatile("outb %0, %1" : : "a"(byte), "Nd"(port) : "memory");
+}
+
+/**
+ * Writes the given 16-bit word to the given port. For index/data register
+ * pairs (like the VGA CRTC) this sets the index from the low byte and the
+ * register at port + 1 from the high byte in one transaction.
+ */
+static inline void outw(u16 port, u16 word) {
+    __asm__ volatile("outw %0, %1" : : "a"(word), "Nd"(port) : "memory");
+}
+
+/**
+ * Loads the page directory at the given physical address into CR3,
+ * which also flushes all non-global TLB entries.
+ */
+extern void load_page_directory(u32 physical_address);
+
+/**
+ * Drops the TLB entry of the page containing the given virtual address (invlpg).
+ */
+extern void invalidate_page(u32 virtual_address);
+
+/**
+ * Returns CR2, the virtual address whose access caused the last page fault.
+ */
+extern u32 read_cr2();
+
+/**
+ * Executes cpuid for the given leaf (subleaf 0) and stores the four result registers.
+ */
+extern void read_cpuid(u32 leaf, u32* eax, u32* ebx, u32* ecx, u32* edx);
+
+/**
+ * Reads a model specific register.
+ */
+extern void read_msr(u32 msr, u32* low, u32* high);
+
+/**
+ * Writes a model specific register.
+ */
+extern void write_msr(u32 msr, u32 low, u32 high);
+
+/**
+ * Writes an MTRR, with caches disabled and flushed around the change as the CPU requires.
+ */
+extern void write_mtrr(u32 msr, u32 low, u32 high);
+
+/**
+ * Divides a 64-bit number by a 32-bit one and stores the remainder (if not 0).
+ * The kernel is not linked against libgcc, where the compiler would get a
+ * 64-bit division from, so u64 values must be divided with this.
+ */
+static inline u64 div_u64(u64 dividend, u32 divisor, u32* remainder) {
+    u32 quotient_high = (u32)(dividend >> 32) / divisor;
+    u32 rest = (u32)(dividend >> 32) % divisor;
+    u32 quotient_low;
+    // rest < divisor, so the quotient of rest:low fits in 32 bits
+    __asm__("divl %4" : "=a"(quotient_low), "=d"(rest) : "0"((u32)dividend), "1"(rest), "rm"(divisor));
+    if (remainder) {
+        *remainder = rest;
+    }
+    return (u64)quotient_high << 32 | quotient_low;
+}
+
+/**
+ * Returns the time stamp counter (rdtsc), in CPU cycles since reset. Faults on
+ * CPUs without a TSC, check tsc_get_khz first.
+ */
+static inline u64 cycles_now() {
+    u64 cycles;
+    __asm__ volatile("rdtsc" : "=A"(cycles)); // edx:eax
+    return cycles;
+}
+
+/**
+ * Detects the TSC and measures its frequency against PIT channel 2. Needs no
+ * interrupts, so it can run before anything else that wants timestamps.
+ */
+extern void tsc_init();
+
+/**
+ * Returns the TSC frequency in kHz measured by tsc_init, 0 if there is no TSC
+ * (or the PIT could not be used to measure it).
+ */
+extern u32 tsc_get_khz();
+
+/**
+ * Returns whether the TSC runs at a constant rate in all power states (cpuid
+ * leaf 0x80000007). Otherwise it may slow down or stop with the CPU and the
+ * frequency measured at boot is only right while the CPU runs at full speed.
+ */
+extern bool tsc_is_invariant();
+
+/**
+ * Converts a number of TSC cycles, usually the difference of two cycles_now
+ * values, to nanoseconds. Returns 0 without a TSC.
+ */
+extern u64 cycles_to_ns(u64 cycles);
+
+typedef struct {
+    u32 pit_us;                  // Time that passed according to the PIT
+    u32 tsc_us;                  // The same according to the TSC and cycles_to_ns
+    u32 measured_khz;            // TSC frequency over this measurement
+    int drift_ppb;               // Parts per billion the TSC ran ahead (or behind, if negative)
+} tsc_drift_t;
+
+/**
+ * Counts the TSC against PIT channel 2 for the given number of seconds (at
+ * most an hour) and reports how far cycles_to_ns drifted from the PIT. Busy
+ * waits the whole time. Returns false without a TSC or PIT.
+ */
+extern bool tsc_measure_drift(u32 seconds, tsc_drift_t* drift);
+
+/**
+ * Makes all stores to write-combining memory done so far visible to the device.
+ */
+extern void flush_write_combining();
+
+/**
+ * Disables interrupts and returns the previous EFLAGS for restore_interrupts.
+ */
+extern u32 save_and_disable_interrupts();
+
+/**
+ * Restores the interrupt flag saved by save_and_disable_interrupts.
+ */
+extern void restore_interrupts(u32 flags);
+
+/**
+ * Clears CR0.TS, FPU and SSE instructions run normally.
+ */
+extern void clear_task_switched();
+
+/**
+ * Sets CR0.TS, the next FPU or SSE instruction raises a Device Not Available exception.
+ */
+extern void set_task_switched();
+
+/**
+ * Saves the FPU (and with fxsr, SSE) registers to a 16 byte aligned area:
+ * fxsave (512 bytes) or fnsave (108 bytes).
+ */
+extern void save_fpu_state(u8* area, bool fxsr);
+
+/**
+ * Loads registers saved by save_fpu_state.
+ */
+extern void restore_fpu_state(u8* area, bool fxsr);
 
 /**
  * Enables interrupts.
@@ -34,6 +204,14 @@ extern void enable_interrupts();
  */
 extern void halt();
 
+/**
+ * Enables interrupts and halts the CPU, with no interrupt taken in between.
+ * Called with interrupts disabled after finding nothing to do, an interrupt
+ * that brings something to do can't be handled before the halt and leave
+ * the CPU sleeping on it.
+ */
+extern void enable_interrupts_and_halt();
+
 /**
  * Initializes GDT.
  */
@@ -64,10 +242,56 @@ extern void init_interrupt_handlers();
 extern void init_exception_handlers();
 
 /**
- * Register a handler for a given interrupt number.
- * The interrupt number must be between [0 and 15].
+ * A handler on the chain of an interrupt line. Devices can share a line, so
+ * a handler returns whether its device raised the interrupt (true ends the
+ * chain) or not (the next handler gets to check). Callers own the structure,
+ * which must stay in place while added.
+ */
+typedef struct interrupt_action {
+    bool (*handler)(u32 interrupt);
+    const char* name;
+    struct interrupt_action* next;
+} interrupt_action_t;
+
+/**
+ * Adds action to the end of the chain of an interrupt line [0 to 15].
+ */
+extern void add_interrupt_handler(u32 interrupt, interrupt_action_t* action);
+
+/**
+ * Removes action from the chain of an interrupt line, returns whether it was on it.
+ */
+extern bool remove_interrupt_handler(u32 interrupt, interrupt_action_t* action);
+
+typedef struct {
+    u32 count;                   // Interrupts handled, spurious ones not included
+    u32 spurious;                // IRQ 7 or 15 raised by the PIC without a request behind it
+    u32 unclaimed;               // Handled interrupts no handler on the chain claimed
+    u64 handler_cycles;          // Time in the handler, in TSC cycles (all times are 0 without a TSC)
+    u32 max_handler_cycles;
+    u32 max_eoi_cycles;          // Longest from entering kernel_interrupt_handler to the end of interrupt
+    u32 handler_histogram[INTERRUPT_HISTOGRAM_BUCKETS];
+    u32 eoi_histogram[INTERRUPT_HISTOGRAM_BUCKETS];
+} interrupt_stats_t;
+
+/**
+ * Copies the statistics of an interrupt line [0 to 15] since boot or the last
+ * reset_interrupt_stats.
+ */
+extern void get_interrupt_stats(u32 interrupt, interrupt_stats_t* stats);
+
+/**
+ * Zeroes the statistics of all interrupt lines.
+ */
+extern void reset_interrupt_stats();
+
+/**
+ * Raises a software interrupt rounds times through the legacy entry path the
+ * IRQs used to take and through the current one, both to a handler that
+ * does nothing. Reports TSC cycles per round trip. Returns false without a
+ * calibrated TSC, rdtsc faults on CPUs that have none.
  */
-extern void set_interrupt_handler(u32 interrupt, void (*handler)(u32 interrupt));
+extern bool benchmark_interrupt_entry(u32 rounds, u32* legacy_cycles, u32* lean_cycles);
 
 /**
  * Registers a handler for exceptions.
@@ -0,0 +1,43 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include "kernel/kernel.h"
+
+// Spec - https://www.gnu.org/software/grub/manual/multiboot/multiboot.html
+
+#define MULTIBOOT_INFO_MEMORY  (1 << 0) // mem_lower/mem_upper are valid
+#define MULTIBOOT_INFO_MEM_MAP (1 << 6) // mmap_addr/mmap_length are valid
+
+#define MULTIBOOT_MEMORY_AVAILABLE 1    // Memory map entry type for usable RAM
+
+/**
+ * Boot information structure. Its physical address is passed by the bootloader in ebx.
+ * Only the fields up to the memory map are described, the rest is not used.
+ */
+typedef struct {
+    u32 flags;
+    u32 mem_lower;   // KiB of memory starting at 0
+    u32 mem_upper;   // KiB of memory starting at 1 MiB
+    u32 boot_device;
+    u32 cmdline;
+    u32 mods_count;
+    u32 mods_addr;
+    u32 syms[4];
+    u32 mmap_length; // Size of the memory map buffer in bytes
+    u32 mmap_addr;   // Physical address of the first memory map entry
+} __attribute__((packed)) multiboot_info_t;
+
+/**
+ * BIOS (E820) memory map entry. The size field does not count itself,
+ * so the next entry starts at (u8*)entry + entry->size + sizeof(entry->size).
+ */
+typedef struct {
+    u32 size;
+    u32 base_low;
+    u32 base_high;
+    u32 length_low;
+    u32 length_high;
+    u32 type;
+} __attribute__((packed)) multiboot_mmap_entry_t;
+
+#endif
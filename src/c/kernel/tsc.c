@@ -0,0 +1,146 @@
+#include "kernel/kernel.h"
+#include "drivers/timer/timer.h"
+
+#define TSC_PIT_CHANNEL2_PORT 0x42
+#define TSC_PIT_COMMAND_PORT 0x43
+#define TSC_PIT_CHANNEL2_RATE 0xB4       // Channel 2, low then high byte, mode 2 (rate generator)
+#define TSC_PIT_CHANNEL2_LATCH 0x80      // Channel 2, latch the count for reading
+#define TSC_GATE_PORT 0x61               // Channel 2 gate (bit 0), speaker (bit 1)
+#define TSC_GATE_CHANNEL2 0x01
+#define TSC_GATE_SPEAKER 0x02
+#define TSC_CPUID_FEATURE_TSC (1 << 4)   // cpuid leaf 1, edx
+#define TSC_CPUID_POWER_LEAF 0x80000007
+#define TSC_CPUID_INVARIANT (1 << 8)     // cpuid leaf 0x80000007, edx
+#define TSC_CALIBRATION_MS 50
+#define TSC_MAX_STALLED_POLLS 100000     // Port reads take about a microsecond, a counting PIT changes every one
+#define TSC_SCALE_SHIFT 22               // ns = cycles * scale >> TSC_SCALE_SHIFT
+#define TSC_NS_PER_MS 1000000
+#define TSC_NS_PER_SECOND 1000000000
+
+static u32 khz = 0;                      // 0 without a TSC or if calibration failed
+static u32 scale = 0;
+static bool invariant = false;
+
+// Helper function to read PIT channel 2, which counts down by one per PIT input cycle
+static u16 read_channel2() {
+    out(TSC_PIT_COMMAND_PORT, TSC_PIT_CHANNEL2_LATCH);
+    u8 low = in(TSC_PIT_CHANNEL2_PORT);
+    return low | (u16)in(TSC_PIT_CHANNEL2_PORT) << 8;
+}
+
+// Helper function to count the TSC against PIT channel 2 for at least the
+// given number of PIT cycles. Channel 2 runs freely with its full 65536
+// cycle period and is polled, so no interrupts are needed and the tick rate
+// of channel 0 does not matter. Both ends are taken right after the count
+// changed, which makes the two readings line up to a PIT cycle. Returns the
+// PIT cycles that passed, 0 if channel 2 stopped counting.
+static u64 measure_against_pit(u64 pit_cycles, u64* tsc_cycles) {
+    u8 gate = in(TSC_GATE_PORT);
+    out(TSC_GATE_PORT, (gate & ~TSC_GATE_SPEAKER) | TSC_GATE_CHANNEL2);
+    out(TSC_PIT_COMMAND_PORT, TSC_PIT_CHANNEL2_RATE);
+    out(TSC_PIT_CHANNEL2_PORT, 0);
+    out(TSC_PIT_CHANNEL2_PORT, 0);
+
+    u64 elapsed = 0;
+    u64 start = 0;
+    *tsc_cycles = 0;
+    u16 last = read_channel2();
+    u32 stalled = 0;
+    bool started = false;
+    while (!started || elapsed < pit_cycles) {
+        u16 count = read_channel2();
+        if (count == last) {
+            if (++stalled == TSC_MAX_STALLED_POLLS) {
+                elapsed = 0;
+                break;
+            }
+            continue;
+        }
+        u64 now = cycles_now();
+        stalled = 0;
+        if (started) {
+            elapsed += (u16)(last - count); // The period is 65536, so this also covers a reload
+        } else {
+            start = now;
+            started = true;
+        }
+        last = count;
+        *tsc_cycles = now - start;
+    }
+
+    out(TSC_GATE_PORT, gate);
+    return elapsed;
+}
+
+// Helper function to convert PIT input cycles to nanoseconds
+static u64 pit_cycles_to_ns(u64 pit_cycles) {
+    u32 rest;
+    u64 seconds = div_u64(pit_cycles, TIMER_PIT_FREQUENCY, &rest);
+    return seconds * TSC_NS_PER_SECOND + div_u64((u64)rest * TSC_NS_PER_SECOND, TIMER_PIT_FREQUENCY, 0);
+}
+
+void tsc_init() {
+    u32 eax, ebx, ecx, edx;
+    read_cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & TSC_CPUID_FEATURE_TSC)) {
+        return;
+    }
+
+    read_cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax >= TSC_CPUID_POWER_LEAF) {
+        read_cpuid(TSC_CPUID_POWER_LEAF, &eax, &ebx, &ecx, &edx);
+        invariant = (edx & TSC_CPUID_INVARIANT) != 0;
+    }
+
+    u64 tsc_cycles;
+    u64 pit_cycles = measure_against_pit(TIMER_PIT_FREQUENCY / 1000 * TSC_CALIBRATION_MS, &tsc_cycles);
+    if (pit_cycles > 0) {
+        khz = (u32)div_u64(tsc_cycles * TIMER_PIT_FREQUENCY, (u32)pit_cycles * 1000, 0);
+    }
+    if (khz > 0) {
+        scale = (u32)div_u64((u64)TSC_NS_PER_MS << TSC_SCALE_SHIFT, khz, 0);
+    }
+}
+
+u32 tsc_get_khz() {
+    return khz;
+}
+
+bool tsc_is_invariant() {
+    return invariant;
+}
+
+u64 cycles_to_ns(u64 cycles) {
+    // cycles * scale needs up to 96 bits, multiply the two halves separately
+    u64 high = (u64)(u32)(cycles >> 32) * scale;
+    u64 low = (u64)(u32)cycles * scale;
+    return (high << (32 - TSC_SCALE_SHIFT)) + (low >> TSC_SCALE_SHIFT);
+}
+
+bool tsc_measure_drift(u32 seconds, tsc_drift_t* drift) {
+    if (khz == 0) {
+        return false;
+    }
+
+    u64 tsc_cycles;
+    u64 pit_cycles = measure_against_pit((u64)seconds * TIMER_PIT_FREQUENCY, &tsc_cycles);
+    if (pit_cycles == 0) {
+        return false;
+    }
+
+    u64 pit_ns = pit_cycles_to_ns(pit_cycles);
+    u64 tsc_ns = cycles_to_ns(tsc_cycles);
+    u32 pit_us = (u32)div_u64(pit_ns, 1000, 0);
+    drift->pit_us = pit_us;
+    drift->tsc_us = (u32)div_u64(tsc_ns, 1000, 0);
+    drift->measured_khz = (u32)div_u64(tsc_cycles * 1000, pit_us, 0);
+
+    // Parts per billion: ns of difference per second is ppb, per us it is ppb / 1000
+    u64 difference = tsc_ns > pit_ns ? tsc_ns - pit_ns : pit_ns - tsc_ns;
+    u64 ppb = div_u64(difference * 1000000, pit_us, 0);
+    if (ppb > 0x7FFFFFFF) {
+        ppb = 0x7FFFFFFF;
+    }
+    drift->drift_ppb = tsc_ns > pit_ns ? (int)ppb : -(int)ppb;
+    return true;
+}
@@ -0,0 +1,94 @@
+#include "kernel/work_queue.h"
+
+#define WORK_QUEUE_MASK (WORK_QUEUE_SIZE - 1)
+
+typedef struct {
+    void (*function)(u32 argument);
+    u32 argument;
+    u64 queued_at;               // cycles_now when queued, 0 without a TSC
+} work_item_t;
+
+// A ring with one producer side (interrupt handlers, which don't nest, or
+// kernel code with interrupts off) and one consumer (the main loop). Each
+// side only writes its own index and reads the other's, so the consumer
+// takes no lock. head and tail count up forever, their difference is the
+// number of queued items.
+static work_item_t ring[WORK_QUEUE_SIZE];
+static volatile u32 head = 0;            // Next slot to fill, written by producers
+static volatile u32 tail = 0;            // Next slot to run, written by the consumer
+static work_queue_stats_t stats;
+
+bool work_queue_push(void (*function)(u32 argument), u32 argument) {
+    u32 flags = save_and_disable_interrupts();
+    u32 slot = head;
+    u32 depth = slot - tail;
+    if (depth == WORK_QUEUE_SIZE) {
+        stats.dropped++;
+        restore_interrupts(flags);
+        return false;
+    }
+
+    work_item_t* item = &ring[slot & WORK_QUEUE_MASK];
+    item->function = function;
+    item->argument = argument;
+    item->queued_at = tsc_get_khz() ? cycles_now() : 0;
+    // The item must be complete before the consumer can see it
+    __asm__ volatile("" ::: "memory");
+    head = slot + 1;
+
+    stats.queued++;
+    if (depth + 1 > stats.max_depth) {
+        stats.max_depth = depth + 1;
+    }
+    restore_interrupts(flags);
+    return true;
+}
+
+// Helper function to clamp a time for the 32-bit maxima
+static inline u32 clamp_ns(u64 ns) {
+    return ns > 0xFFFFFFFF ? 0xFFFFFFFF : (u32)ns;
+}
+
+u32 work_queue_run() {
+    u32 ran = 0;
+    while (tail != head) {
+        // Copy the item out first, its slot is free for producers once tail moves on
+        u32 slot = tail;
+        work_item_t item = ring[slot & WORK_QUEUE_MASK];
+        __asm__ volatile("" ::: "memory");
+        tail = slot + 1;
+
+        u64 start = item.queued_at ? cycles_now() : 0;
+        item.function(item.argument);
+        if (item.queued_at) {
+            u64 end = cycles_now();
+            u32 wait_ns = clamp_ns(cycles_to_ns(start - item.queued_at));
+            u32 run_ns = clamp_ns(cycles_to_ns(end - start));
+            if (wait_ns > stats.max_wait_ns) {
+                stats.max_wait_ns = wait_ns;
+            }
+            if (run_ns > stats.max_run_ns) {
+                stats.max_run_ns = run_ns;
+            }
+            stats.total_run_ns += run_ns;
+        }
+        stats.ran++;
+        ran++;
+    }
+    return ran;
+}
+
+void work_queue_idle() {
+    u32 flags = save_and_disable_interrupts();
+    if (tail != head) {
+        restore_interrupts(flags);
+        return;
+    }
+    enable_interrupts_and_halt();
+}
+
+void work_queue_get_stats(work_queue_stats_t* copy) {
+    u32 flags = save_and_disable_interrupts();
+    *copy = stats;
+    restore_interrupts(flags);
+}
@@ -0,0 +1,39 @@
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include "kernel/kernel.h"
+
+// Interrupt handlers do the least they can and queue the rest as work items,
+// which the main loop runs with interrupts enabled. Slots of the ring, a
+// power of two.
+#define WORK_QUEUE_SIZE 64
+
+typedef struct {
+    u32 queued;                  // Items ever queued
+    u32 dropped;                 // Items that did not fit
+    u32 ran;                     // Items that ran to completion
+    u32 max_depth;               // Most items waiting at once
+    u32 max_wait_ns;             // Longest an item waited to run (needs a TSC, as the times below)
+    u32 max_run_ns;              // Longest an item ran
+    u64 total_run_ns;
+} work_queue_stats_t;
+
+// Queue function to be called with argument from the main loop. Safe from
+// interrupt handlers and kernel code alike, the producer side only keeps
+// interrupts off for the few instructions that fill a slot. Returns false
+// (and counts the item as dropped) if the ring is full.
+bool work_queue_push(void (*function)(u32 argument), u32 argument);
+
+// Run queued items until there are none left, in the order they were queued.
+// Called with interrupts enabled, items may queue more items. Returns how
+// many ran.
+u32 work_queue_run();
+
+// Sleep until the next interrupt, unless items are queued already. Wakes up
+// for items queued by the interrupts that end the sleep.
+void work_queue_idle();
+
+// Get the counters since boot
+void work_queue_get_stats(work_queue_stats_t* stats);
+
+#endif
@@ -0,0 +1,221 @@
+#include "libk/mem.h"
+#include "kernel/fpu.h"
+
+#define LIBK_SSE2_BLOCK_SIZE 64      // Bytes moved per loop iteration, four xmm registers
+#define LIBK_SSE2_CHUNK_SIZE 16      // Bytes compared per loop iteration
+#define LIBK_CPUID_EBX_ERMSB (1 << 9) // cpuid leaf 7: fast rep movsb/stosb
+
+// Word accesses into byte buffers
+typedef u32 __attribute__((may_alias)) libk_word_t;
+
+static bool use_sse2 = false;                // Backward moves and compares
+static bool use_sse2_forward = false;        // Forward copies and fills
+
+// Helper function to copy forwards, rep movsd and then rep movsb for the rest.
+// Also right for overlapping areas when destination is below source.
+static inline void copy_forward(void* destination, const void* source, u32 count) {
+    u32 dwords = count / 4;
+    __asm__ volatile("rep movsl\n\t"
+                     "mov %3, %%ecx\n\t"
+                     "rep movsb"
+                     : "+D"(destination), "+S"(source), "+c"(dwords)
+                     : "r"(count % 4)
+                     : "memory");
+}
+
+// Helper function to copy backwards, for overlapping areas when destination is
+// above source. rep movs backwards (std) is slow on most CPUs, a word loop isn't.
+static void copy_backward(u8* destination, const u8* source, u32 count) {
+    while (count % 4) {
+        count--;
+        destination[count] = source[count];
+    }
+    while (count) {
+        count -= 4;
+        *(libk_word_t*)(destination + count) = *(const libk_word_t*)(source + count);
+    }
+}
+
+// Helper function to fill with rep stosd and then rep stosb for the rest
+static inline void fill_forward(void* destination, u32 pattern, u32 count) {
+    u32 dwords = count / 4;
+    __asm__ volatile("rep stosl\n\t"
+                     "mov %3, %%ecx\n\t"
+                     "rep stosb"
+                     : "+D"(destination), "+c"(dwords)
+                     : "a"(pattern), "r"(count % 4)
+                     : "memory");
+}
+
+// Helper function to copy blocks of LIBK_SSE2_BLOCK_SIZE bytes upwards (blocks > 0).
+// All four loads of a block come before its stores, so destination below source is fine.
+__attribute__((target("sse2")))
+static void copy_blocks_sse2(void* destination, const void* source, u32 blocks) {
+    __asm__ volatile("1:\n\t"
+                     "movdqu (%1), %%xmm0\n\t"
+                     "movdqu 16(%1), %%xmm1\n\t"
+                     "movdqu 32(%1), %%xmm2\n\t"
+                     "movdqu 48(%1), %%xmm3\n\t"
+                     "movdqu %%xmm0, (%0)\n\t"
+                     "movdqu %%xmm1, 16(%0)\n\t"
+                     "movdqu %%xmm2, 32(%0)\n\t"
+                     "movdqu %%xmm3, 48(%0)\n\t"
+                     "add $64, %1\n\t"
+                     "add $64, %0\n\t"
+                     "dec %2\n\t"
+                     "jnz 1b"
+                     : "+r"(destination), "+r"(source), "+r"(blocks)
+                     :
+                     : "xmm0", "xmm1", "xmm2", "xmm3", "memory", "cc");
+}
+
+// Helper function to copy blocks downwards, starting with the block at
+// destination/source (blocks > 0). For destination above source.
+__attribute__((target("sse2")))
+static void copy_blocks_backward_sse2(void* destination, const void* source, u32 blocks) {
+    __asm__ volatile("1:\n\t"
+                     "movdqu (%1), %%xmm0\n\t"
+                     "movdqu 16(%1), %%xmm1\n\t"
+                     "movdqu 32(%1), %%xmm2\n\t"
+                     "movdqu 48(%1), %%xmm3\n\t"
+                     "movdqu %%xmm0, (%0)\n\t"
+                     "movdqu %%xmm1, 16(%0)\n\t"
+                     "movdqu %%xmm2, 32(%0)\n\t"
+                     "movdqu %%xmm3, 48(%0)\n\t"
+                     "sub $64, %1\n\t"
+                     "sub $64, %0\n\t"
+                     "dec %2\n\t"
+                     "jnz 1b"
+                     : "+r"(destination), "+r"(source), "+r"(blocks)
+                     :
+                     : "xmm0", "xmm1", "xmm2", "xmm3", "memory", "cc");
+}
+
+// Helper function to fill blocks of LIBK_SSE2_BLOCK_SIZE bytes (blocks > 0)
+__attribute__((target("sse2")))
+static void fill_blocks_sse2(void* destination, u32 pattern, u32 blocks) {
+    __asm__ volatile("movd %2, %%xmm0\n\t"
+                     "pshufd $0, %%xmm0, %%xmm0\n\t"
+                     "1:\n\t"
+                     "movdqu %%xmm0, (%0)\n\t"
+                     "movdqu %%xmm0, 16(%0)\n\t"
+                     "movdqu %%xmm0, 32(%0)\n\t"
+                     "movdqu %%xmm0, 48(%0)\n\t"
+                     "add $64, %0\n\t"
+                     "dec %1\n\t"
+                     "jnz 1b"
+                     : "+r"(destination), "+r"(blocks)
+                     : "r"(pattern)
+                     : "xmm0", "memory", "cc");
+}
+
+// Helper function to find the first LIBK_SSE2_CHUNK_SIZE byte chunk that differs
+// (chunks > 0). Returns its offset, or chunks * LIBK_SSE2_CHUNK_SIZE if all are equal.
+__attribute__((target("sse2")))
+static u32 compare_chunks_sse2(const void* left, const void* right, u32 chunks) {
+    u32 offset = 0;
+    u32 mask;
+    __asm__ volatile("1:\n\t"
+                     "movdqu (%3,%0), %%xmm0\n\t"
+                     "movdqu (%4,%0), %%xmm1\n\t"
+                     "pcmpeqb %%xmm1, %%xmm0\n\t"
+                     "pmovmskb %%xmm0, %2\n\t"
+                     "cmp $0xFFFF, %2\n\t"
+                     "jne 2f\n\t"
+                     "add $16, %0\n\t"
+                     "dec %1\n\t"
+                     "jnz 1b\n\t"
+                     "2:"
+                     : "+r"(offset), "+r"(chunks), "=&r"(mask)
+                     : "r"(left), "r"(right)
+                     : "xmm0", "xmm1", "memory", "cc");
+    return offset;
+}
+
+void libk_init() {
+    use_sse2 = fpu_has_feature(FPU_FEATURE_SSE2);
+
+    // With ERMSB, rep movs/stos run in cache line sized chunks and beat the SSE2 loops
+    u32 max_leaf, ebx, ecx, edx;
+    read_cpuid(0, &max_leaf, &ebx, &ecx, &edx);
+    bool fast_strings = false;
+    if (max_leaf >= 7) {
+        u32 eax;
+        read_cpuid(7, &eax, &ebx, &ecx, &edx);
+        fast_strings = (ebx & LIBK_CPUID_EBX_ERMSB) != 0;
+    }
+    use_sse2_forward = use_sse2 && !fast_strings;
+}
+
+void* memcpy(void* destination, const void* source, u32 count) {
+    u8* to = destination;
+    const u8* from = source;
+    if (use_sse2_forward && count >= LIBK_SSE2_MIN_SIZE) {
+        u32 blocks = count / LIBK_SSE2_BLOCK_SIZE;
+        kernel_fpu_begin();
+        copy_blocks_sse2(to, from, blocks);
+        kernel_fpu_end();
+        to += blocks * LIBK_SSE2_BLOCK_SIZE;
+        from += blocks * LIBK_SSE2_BLOCK_SIZE;
+        count %= LIBK_SSE2_BLOCK_SIZE;
+    }
+    copy_forward(to, from, count);
+    return destination;
+}
+
+void* memmove(void* destination, const void* source, u32 count) {
+    u8* to = destination;
+    const u8* from = source;
+    if (to <= from || to >= from + count) {
+        return memcpy(destination, source, count); // Copying upwards never overwrites unread bytes
+    }
+
+    if (use_sse2 && count >= LIBK_SSE2_MIN_SIZE) {
+        u32 blocks = count / LIBK_SSE2_BLOCK_SIZE;
+        u32 head = count % LIBK_SSE2_BLOCK_SIZE;
+        u32 last_block = head + (blocks - 1) * LIBK_SSE2_BLOCK_SIZE;
+        kernel_fpu_begin();
+        copy_blocks_backward_sse2(to + last_block, from + last_block, blocks);
+        kernel_fpu_end();
+        count = head;
+    }
+    copy_backward(to, from, count);
+    return destination;
+}
+
+void* memset(void* destination, int value, u32 count) {
+    u8* to = destination;
+    u32 pattern = (u8)value * 0x01010101u;
+    if (use_sse2_forward && count >= LIBK_SSE2_MIN_SIZE) {
+        u32 blocks = count / LIBK_SSE2_BLOCK_SIZE;
+        kernel_fpu_begin();
+        fill_blocks_sse2(to, pattern, blocks);
+        kernel_fpu_end();
+        to += blocks * LIBK_SSE2_BLOCK_SIZE;
+        count %= LIBK_SSE2_BLOCK_SIZE;
+    }
+    fill_forward(to, pattern, count);
+    return destination;
+}
+
+int memcmp(const void* left, const void* right, u32 count) {
+    const u8* a = left;
+    const u8* b = right;
+    u32 offset = 0;
+    if (use_sse2 && count >= LIBK_SSE2_MIN_SIZE) {
+        kernel_fpu_begin();
+        offset = compare_chunks_sse2(a, b, count / LIBK_SSE2_CHUNK_SIZE);
+        kernel_fpu_end();
+    }
+
+    // Skip equal words, the bytes of the first differing one decide
+    while (offset + 4 <= count && *(const libk_word_t*)(a + offset) == *(const libk_word_t*)(b + offset)) {
+        offset += 4;
+    }
+    for (; offset < count; offset++) {
+        if (a[offset] != b[offset]) {
+            return a[offset] - b[offset];
+        }
+    }
+    return 0;
+}
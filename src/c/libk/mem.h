@@ -0,0 +1,28 @@
+#ifndef LIBK_MEM_H
+#define LIBK_MEM_H
+
+#include "kernel/kernel.h"
+
+// From this many bytes on, memcpy/memmove/memset/memcmp use SSE2 when the CPU
+// has it. Below it kernel_fpu_begin/end (CR0 writes) cost more than the wider
+// loads and stores save over rep movsd/stosd.
+#define LIBK_SSE2_MIN_SIZE 2048
+
+// Pick the implementations for this CPU, call after fpu_init. memcpy and
+// memset stay with rep movs/stos on CPUs with fast strings (ERMSB).
+// Until then the rep movsd/stosd versions are used.
+void libk_init();
+
+// Copy count bytes, the areas must not overlap
+void* memcpy(void* destination, const void* source, u32 count);
+
+// Copy count bytes, the areas may overlap
+void* memmove(void* destination, const void* source, u32 count);
+
+// Set count bytes to value (converted to u8)
+void* memset(void* destination, int value, u32 count);
+
+// Compare count bytes: negative, 0 or positive like the first differing byte
+int memcmp(const void* left, const void* right, u32 count);
+
+#endif
@@ -0,0 +1,291 @@
+#include "libk/printf.h"
+#include "libk/mem.h"
+#include "libk/string.h"
+#include "drivers/vga/vga.h"
+#include "drivers/serial_port/serial_port.h"
+
+#define KPRINTF_NUMBER_SIZE 12       // "-2147483648" or "0x" and 8 hex digits, no terminator
+#define KPRINTF_PAD_SIZE 16          // Padding is written in runs of up to this many characters
+
+#define KPRINTF_FLAG_LEFT 0x1
+#define KPRINTF_FLAG_ZERO 0x2
+#define KPRINTF_FLAG_PREFIX 0x4
+
+// Where formatted text goes: a buffer that is either cut short (ksnprintf)
+// or written out to the targets whenever it fills up (kprintf)
+typedef struct {
+    char* buffer;
+    u32 capacity;                // Bytes of buffer that may hold text
+    u32 length;                  // Bytes of buffer in use
+    u32 total;                   // Length of the whole output so far
+    u32 targets;                 // KPRINTF_* targets to flush to, 0 to cut short
+    u8 fg_color;
+    u8 bg_color;
+} kprintf_output_t;
+
+// "00" to "99", so decimal numbers are written two digits per division
+static const char decimal_pairs[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char hex_digits_lower[16] = "0123456789abcdef";
+static const char hex_digits_upper[16] = "0123456789ABCDEF";
+
+// Helper function to write out and empty the buffer of an output
+static void flush_output(kprintf_output_t* output) {
+    if (output->targets & KPRINTF_VGA) {
+        vga_write(output->buffer, output->length, output->fg_color, output->bg_color);
+    }
+    if (output->targets & KPRINTF_SERIAL) {
+        // The serial console wants \r\n, send the text between newlines in one piece
+        u32 start = 0;
+        for (u32 i = 0; i < output->length; i++) {
+            if (output->buffer[i] == '\n') {
+                serial_write(&output->buffer[start], i - start);
+                serial_write("\r\n", 2);
+                start = i + 1;
+            }
+        }
+        serial_write(&output->buffer[start], output->length - start);
+    }
+    output->length = 0;
+}
+
+// Helper function to append text to an output
+static void append(kprintf_output_t* output, const char* text, u32 length) {
+    output->total += length;
+    while (length > 0) {
+        u32 space = output->capacity - output->length;
+        if (space == 0) {
+            if (!output->targets) {
+                return; // Cut short, only the total keeps counting
+            }
+            flush_output(output);
+            space = output->capacity;
+        }
+        u32 chunk = length < space ? length : space;
+        memcpy(&output->buffer[output->length], text, chunk);
+        output->length += chunk;
+        text += chunk;
+        length -= chunk;
+    }
+}
+
+// Helper function to append count copies of c
+static void append_fill(kprintf_output_t* output, char c, u32 count) {
+    char run[KPRINTF_PAD_SIZE];
+    memset(run, c, count < KPRINTF_PAD_SIZE ? count : KPRINTF_PAD_SIZE);
+    while (count > 0) {
+        u32 chunk = count < KPRINTF_PAD_SIZE ? count : KPRINTF_PAD_SIZE;
+        append(output, run, chunk);
+        count -= chunk;
+    }
+}
+
+// Helper function to write the decimal digits of value backwards from end,
+// two at a time. Returns where they start.
+static char* format_decimal(char* end, u32 value) {
+    while (value >= 100) {
+        const char* pair = &decimal_pairs[(value % 100) * 2];
+        value /= 100;
+        end -= 2;
+        end[0] = pair[0];
+        end[1] = pair[1];
+    }
+    if (value >= 10) {
+        end -= 2;
+        end[0] = decimal_pairs[value * 2];
+        end[1] = decimal_pairs[value * 2 + 1];
+    } else {
+        *--end = '0' + value;
+    }
+    return end;
+}
+
+// Helper function to write the hex digits of value backwards from end, returns where they start
+static char* format_hex(char* end, u32 value, const char* digits) {
+    do {
+        *--end = digits[value & 0xF];
+        value >>= 4;
+    } while (value);
+    return end;
+}
+
+// Helper function to append prefix (a sign or 0x) and text padded to width
+static void append_padded(kprintf_output_t* output, const char* prefix, u32 prefix_length,
+                          const char* text, u32 length, u32 width, u32 flags) {
+    u32 padding = width > prefix_length + length ? width - prefix_length - length : 0;
+    if (flags & KPRINTF_FLAG_LEFT) {
+        append(output, prefix, prefix_length);
+        append(output, text, length);
+        append_fill(output, ' ', padding);
+    } else if (flags & KPRINTF_FLAG_ZERO) {
+        append(output, prefix, prefix_length);
+        append_fill(output, '0', padding);
+        append(output, text, length);
+    } else {
+        append_fill(output, ' ', padding);
+        append(output, prefix, prefix_length);
+        append(output, text, length);
+    }
+}
+
+// Helper function to read a width or precision, either digits or * for the next argument
+static u32 read_count(const char** format, va_list* args) {
+    if (**format == '*') {
+        (*format)++;
+        int count = va_arg(*args, int);
+        return count < 0 ? 0 : (u32)count;
+    }
+    u32 count = 0;
+    while (**format >= '0' && **format <= '9') {
+        count = count * 10 + (**format - '0');
+        (*format)++;
+    }
+    return count;
+}
+
+// Helper function to format into an output, the core of all the functions
+static void format_output(kprintf_output_t* output, const char* format, va_list args) {
+    va_list arguments;
+    va_copy(arguments, args);
+
+    while (*format) {
+        // Copy the text up to the next conversion in one piece
+        const char* text = format;
+        while (*format && *format != '%') {
+            format++;
+        }
+        append(output, text, format - text);
+        if (!*format) {
+            break;
+        }
+        format++;
+
+        u32 flags = 0;
+        for (;; format++) {
+            if (*format == '-') {
+                flags |= KPRINTF_FLAG_LEFT;
+            } else if (*format == '0') {
+                flags |= KPRINTF_FLAG_ZERO;
+            } else if (*format == '#') {
+                flags |= KPRINTF_FLAG_PREFIX;
+            } else {
+                break;
+            }
+        }
+        u32 width = read_count(&format, &arguments);
+        u32 precision = 0xFFFFFFFF;
+        if (*format == '.') {
+            format++;
+            precision = read_count(&format, &arguments);
+        }
+        while (*format == 'l') {
+            format++;
+        }
+
+        char number[KPRINTF_NUMBER_SIZE];
+        char* end = number + KPRINTF_NUMBER_SIZE;
+        char* digits;
+        switch (*format) {
+            case 'd':
+            case 'i': {
+                int value = va_arg(arguments, int);
+                // Negate as unsigned, -INT_MIN does not fit in an int
+                digits = format_decimal(end, value < 0 ? 0u - (u32)value : (u32)value);
+                append_padded(output, "-", value < 0, digits, end - digits, width, flags);
+                break;
+            }
+            case 'u':
+                digits = format_decimal(end, va_arg(arguments, u32));
+                append_padded(output, "", 0, digits, end - digits, width, flags);
+                break;
+            case 'x':
+            case 'X':
+                digits = format_hex(end, va_arg(arguments, u32), *format == 'x' ? hex_digits_lower : hex_digits_upper);
+                append_padded(output, "0x", flags & KPRINTF_FLAG_PREFIX ? 2 : 0, digits, end - digits, width, flags);
+                break;
+            case 'p': {
+                // Always all 8 digits, addresses line up
+                u32 value = (u32)va_arg(arguments, void*);
+                for (digits = end; digits > end - 8; value >>= 4) {
+                    *--digits = hex_digits_lower[value & 0xF];
+                }
+                append_padded(output, "0x", 2, digits, 8, width, flags & ~KPRINTF_FLAG_ZERO);
+                break;
+            }
+            case 'c':
+                number[0] = (char)va_arg(arguments, int);
+                append_padded(output, "", 0, number, 1, width, flags & ~KPRINTF_FLAG_ZERO);
+                break;
+            case 's': {
+                const char* str = va_arg(arguments, const char*);
+                if (!str) {
+                    str = "(null)";
+                }
+                append_padded(output, "", 0, str, strnlen(str, precision), width, flags & ~KPRINTF_FLAG_ZERO);
+                break;
+            }
+            case '%':
+                append(output, "%", 1);
+                break;
+            case '\0':
+                format--; // A lone % at the end, stop at the terminator
+                break;
+            default:
+                append(output, "%", 1); // Unknown conversion, printed as is
+                append(output, format, 1);
+                break;
+        }
+        format++;
+    }
+    va_end(arguments);
+}
+
+u32 kvsnprintf(char* buffer, u32 size, const char* format, va_list args) {
+    kprintf_output_t output = {buffer, size > 0 ? size - 1 : 0, 0, 0, 0, 0, 0};
+    format_output(&output, format, args);
+    if (size > 0) {
+        buffer[output.length] = '\0';
+    }
+    return output.total;
+}
+
+u32 ksnprintf(char* buffer, u32 size, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    u32 length = kvsnprintf(buffer, size, format, args);
+    va_end(args);
+    return length;
+}
+
+void kvprintf_to(u32 targets, u8 fg_color, u8 bg_color, const char* format, va_list args) {
+    char line[KPRINTF_LINE_SIZE];
+    kprintf_output_t output = {line, KPRINTF_LINE_SIZE, 0, 0, targets, fg_color, bg_color};
+    format_output(&output, format, args);
+    flush_output(&output);
+}
+
+void kprintf_to(u32 targets, u8 fg_color, u8 bg_color, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    kvprintf_to(targets, fg_color, bg_color, format, args);
+    va_end(args);
+}
+
+void kprintf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    kvprintf_to(KPRINTF_VGA, VGA_DEFAULT_FG, VGA_DEFAULT_BG, format, args);
+    va_end(args);
+}
+
+void kprintf_color(u8 fg_color, u8 bg_color, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    kvprintf_to(KPRINTF_VGA, fg_color, bg_color, format, args);
+    va_end(args);
+}
@@ -0,0 +1,36 @@
+#ifndef LIBK_PRINTF_H
+#define LIBK_PRINTF_H
+
+#include <stdarg.h>
+#include "kernel/kernel.h"
+
+// Where kprintf_to writes to
+#define KPRINTF_VGA 0x1
+#define KPRINTF_SERIAL 0x2              // Newlines are sent as \r\n
+
+// Output is staged in a line buffer on the stack and written to the screen
+// and serial port a buffer at a time, with one cursor update per flush
+#define KPRINTF_LINE_SIZE 128
+
+// Formats understood by all functions below: %d %i %u %x %X %c %s %p %%,
+// the flags '-' (left align), '0' (zero padding) and '#' (0x in front of %x),
+// a field width (digits or *) and a precision for %s (.digits or .*).
+// An 'l' length modifier is accepted and ignored, long is 32 bits here.
+
+// Format into buffer, which holds size bytes and is always terminated (if
+// size > 0). Returns the length of the whole output, so a return value
+// >= size means it was cut short.
+u32 ksnprintf(char* buffer, u32 size, const char* format, ...) __attribute__((format(printf, 3, 4)));
+u32 kvsnprintf(char* buffer, u32 size, const char* format, va_list args);
+
+// Print to the screen in the default colors
+void kprintf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+// Print to the screen in the given colors
+void kprintf_color(u8 fg_color, u8 bg_color, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+// Print to the KPRINTF_* targets, the screen in the given colors
+void kprintf_to(u32 targets, u8 fg_color, u8 bg_color, const char* format, ...) __attribute__((format(printf, 4, 5)));
+void kvprintf_to(u32 targets, u8 fg_color, u8 bg_color, const char* format, va_list args);
+
+#endif
@@ -0,0 +1,204 @@
+#include "libk/string.h"
+#include "libk/mem.h"
+#include "kernel/fpu.h"
+
+#define LIBK_ONE_BITS 0x01010101     // Lowest bit of every byte in a word
+#define LIBK_HIGH_BITS 0x80808080    // Highest bit of every byte in a word
+#define LIBK_SSE2_SCAN_SIZE 16       // Bytes checked per step of find_zero_sse2
+
+// Word accesses into strings, see libk_word_t in mem.c
+typedef u32 __attribute__((may_alias)) libk_string_word_t;
+
+// Helper function to check whether a word holds a zero byte. Subtracting 1
+// from a zero byte sets its high bit, & ~word drops bytes that had it set
+// before. Borrows only run upwards from a zero byte, so the result is not 0
+// exactly when there is one.
+static inline u32 has_zero_byte(u32 word) {
+    return (word - LIBK_ONE_BITS) & ~word & LIBK_HIGH_BITS;
+}
+
+// Helper function to find the first zero byte from str on, which must be
+// LIBK_SSE2_SCAN_SIZE aligned so no load crosses into the next page. Returns
+// its offset from str.
+__attribute__((target("sse2")))
+static u32 find_zero_sse2(const char* str) {
+    u32 offset = 0;
+    u32 mask;
+    __asm__ volatile("pxor %%xmm0, %%xmm0\n\t"
+                     "1:\n\t"
+                     "movdqa (%2,%0), %%xmm1\n\t"
+                     "pcmpeqb %%xmm0, %%xmm1\n\t"
+                     "pmovmskb %%xmm1, %1\n\t"
+                     "test %1, %1\n\t"
+                     "jnz 2f\n\t"
+                     "add $16, %0\n\t"
+                     "jmp 1b\n\t"
+                     "2:"
+                     : "+r"(offset), "=&r"(mask)
+                     : "r"(str)
+                     : "xmm0", "xmm1", "memory", "cc");
+    return offset + __builtin_ctz(mask);
+}
+
+// Helper function to get the value of a hex digit, 16 for any other character
+static u32 hex_digit_value(char c) {
+    u32 digit = (u8)c - '0';
+    if (digit < 10) {
+        return digit;
+    }
+    digit = ((u8)c | 0x20) - 'a'; // Folds 'A'-'F' onto 'a'-'f'
+    return digit < 6 ? digit + 10 : 16;
+}
+
+// Helper function to hand out a parsed number, rest being the first character after it
+static bool finish_parse(const char* rest, u32 result, u32* value, const char** end) {
+    if (end) {
+        *end = rest;
+    } else if (*rest) {
+        return false;
+    }
+    *value = result;
+    return true;
+}
+
+u32 strlen(const char* str) {
+    u32 length = 0;
+    while ((u32)(str + length) % 4) {
+        if (!str[length]) {
+            return length;
+        }
+        length++;
+    }
+
+    // Aligned loads never cross into the next page, so reading the bytes
+    // behind the terminator in the same word can't fault
+    while (!has_zero_byte(*(const libk_string_word_t*)(str + length))) {
+        length += 4;
+        if (length >= LIBK_SSE2_MIN_SIZE && (u32)(str + length) % LIBK_SSE2_SCAN_SIZE == 0 &&
+            fpu_has_feature(FPU_FEATURE_SSE2)) {
+            kernel_fpu_begin();
+            length += find_zero_sse2(str + length);
+            kernel_fpu_end();
+            return length;
+        }
+    }
+    while (str[length]) {
+        length++;
+    }
+    return length;
+}
+
+u32 strnlen(const char* str, u32 max_length) {
+    u32 length = 0;
+    while (length < max_length && (u32)(str + length) % 4) {
+        if (!str[length]) {
+            return length;
+        }
+        length++;
+    }
+    while (max_length - length >= 4 && !has_zero_byte(*(const libk_string_word_t*)(str + length))) {
+        length += 4;
+    }
+    while (length < max_length && str[length]) {
+        length++;
+    }
+    return length;
+}
+
+int strcmp(const char* left, const char* right) {
+    return strncmp(left, right, 0xFFFFFFFF);
+}
+
+int strncmp(const char* left, const char* right, u32 count) {
+    const u8* a = (const u8*)left;
+    const u8* b = (const u8*)right;
+
+    // Whole words only line up when both strings have the same alignment,
+    // otherwise one side would need loads that may cross into the next page
+    if ((u32)a % 4 == (u32)b % 4) {
+        while (count && (u32)a % 4) {
+            if (*a != *b || !*a) {
+                return *a - *b;
+            }
+            a++;
+            b++;
+            count--;
+        }
+        // Skip equal words without a terminator, the bytes of the first other one decide
+        while (count >= 4) {
+            u32 word = *(const libk_string_word_t*)a;
+            if (word != *(const libk_string_word_t*)b || has_zero_byte(word)) {
+                break;
+            }
+            a += 4;
+            b += 4;
+            count -= 4;
+        }
+    }
+
+    for (; count; count--) {
+        if (*a != *b || !*a) {
+            return *a - *b;
+        }
+        a++;
+        b++;
+    }
+    return 0;
+}
+
+char* strncpy(char* destination, const char* source, u32 count) {
+    u32 length = strnlen(source, count);
+    memcpy(destination, source, length);
+    memset(destination + length, 0, count - length);
+    return destination;
+}
+
+u32 strlcpy(char* destination, const char* source, u32 size) {
+    u32 length = strlen(source);
+    if (size > 0) {
+        u32 copy_length = length < size ? length : size - 1;
+        memcpy(destination, source, copy_length);
+        destination[copy_length] = '\0';
+    }
+    return length;
+}
+
+bool parse_u32(const char* str, u32* value, const char** end) {
+    u32 digit = (u8)*str - '0';
+    if (digit >= 10) {
+        return false;
+    }
+
+    u32 result = 0;
+    do {
+        // Compare against the limit instead of checking the multiplication afterwards
+        if (result > 0xFFFFFFFF / 10 || (result == 0xFFFFFFFF / 10 && digit > 0xFFFFFFFF % 10)) {
+            return false;
+        }
+        result = result * 10 + digit;
+        str++;
+        digit = (u8)*str - '0';
+    } while (digit < 10);
+    return finish_parse(str, result, value, end);
+}
+
+bool parse_hex(const char* str, u32* value, const char** end) {
+    if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X') && hex_digit_value(str[2]) < 16) {
+        str += 2;
+    }
+    u32 digit = hex_digit_value(*str);
+    if (digit >= 16) {
+        return false;
+    }
+
+    u32 result = 0;
+    do {
+        if (result >> 28) {
+            return false; // Another digit would shift out the top one
+        }
+        result = result << 4 | digit;
+        str++;
+        digit = hex_digit_value(*str);
+    } while (digit < 16);
+    return finish_parse(str, result, value, end);
+}
@@ -0,0 +1,37 @@
+#ifndef LIBK_STRING_H
+#define LIBK_STRING_H
+
+#include "kernel/kernel.h"
+
+// Length of a null-terminated string. Scans a word at a time and switches to
+// SSE2 once a string turns out to be longer than LIBK_SSE2_MIN_SIZE.
+u32 strlen(const char* str);
+
+// Like strlen, but looks at no more than max_length bytes
+u32 strnlen(const char* str, u32 max_length);
+
+// Compare two strings: negative, 0 or positive like the first differing byte
+int strcmp(const char* left, const char* right);
+
+// Like strcmp, but compares no more than count bytes
+int strncmp(const char* left, const char* right, u32 count);
+
+// Copy at most count bytes of source and fill the rest of the count bytes with
+// zeros. Like the C version, destination is not terminated if source is too long.
+char* strncpy(char* destination, const char* source, u32 count);
+
+// Copy source into a buffer of size bytes, cutting it short if needed. The
+// result is always terminated (if size > 0). Returns strlen(source), so a
+// return value >= size means source did not fit.
+u32 strlcpy(char* destination, const char* source, u32 size);
+
+// Parse a decimal number. Returns false if str doesn't start with a digit or
+// the number doesn't fit in a u32. With end, *end is set to the first
+// character after the digits; without it the whole string must be the number.
+bool parse_u32(const char* str, u32* value, const char** end);
+
+// Parse a hexadecimal number, digits in either case and an optional 0x prefix.
+// Same rules as parse_u32.
+bool parse_hex(const char* str, u32* value, const char** end);
+
+#endif
@@ -0,0 +1,143 @@
+#include "memory/arena.h"
+#include "memory/memory.h"
+#include "memory/paging.h"
+#include "memory/vm.h"
+
+// Helper function to get the first usable (aligned) byte of a chunk
+static u8* chunk_data(arena_chunk_t* chunk) {
+    return (u8*)(((u32)(chunk + 1) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1));
+}
+
+// Helper function to get a new chunk from the heap, large enough for size bytes
+static arena_chunk_t* chunk_create(arena_t* arena, u32 size) {
+    u32 chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+    arena_chunk_t* chunk = (arena_chunk_t*)malloc_tagged(sizeof(arena_chunk_t) + ARENA_ALIGNMENT + chunk_size);
+    if (!chunk) {
+        return 0;
+    }
+    chunk->next = 0;
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    return chunk;
+}
+
+// Helper function to round an address up to a page boundary
+static u32 page_round_up(u32 address) {
+    return (address + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+// Helper function to give back the frames a reserved arena touched past its
+// usual chunk size. The pages are committed again, so they cost nothing
+// until the next large allocation touches them.
+static void release_tail(arena_t* arena) {
+    u32 data = (u32)chunk_data(arena->first);
+    u32 keep = page_round_up(data + arena->chunk_size);
+    u32 end = page_round_up(data + arena->first->used);
+    if (end > keep) {
+        vm_decommit(keep, end - keep);
+        vm_commit(keep, end - keep);
+    }
+}
+
+void arena_init(arena_t* arena, u32 chunk_size) {
+    arena->first = 0;
+    arena->current = 0;
+    arena->chunk_size = (chunk_size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    arena->reserved = 0;
+}
+
+void arena_init_reserved(arena_t* arena, u32 chunk_size, u32 reserve_size) {
+    arena_init(arena, chunk_size);
+    reserve_size = page_round_up(reserve_size);
+    u32 start = vm_reserve(reserve_size);
+    if (start == 0) {
+        return;
+    }
+    if (!vm_commit(start, reserve_size)) {
+        vm_release(start);
+        return;
+    }
+
+    // Writing the header backs the first page, the rest waits for its first use
+    arena_chunk_t* chunk = (arena_chunk_t*)start;
+    chunk->next = 0;
+    chunk->size = start + reserve_size - (u32)chunk_data(chunk);
+    chunk->used = 0;
+    arena->first = chunk;
+    arena->current = chunk;
+    arena->reserved = reserve_size;
+}
+
+void* arena_alloc(arena_t* arena, u32 size) {
+    if (size == 0 || size > 0x7FFFFFFF) {
+        return 0;
+    }
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+    if (!arena->current) {
+        arena->first = chunk_create(arena, size);
+        arena->current = arena->first;
+        if (!arena->current) {
+            return 0;
+        }
+    }
+
+    // Move on to the next chunk (left over from before the last reset) or a new one.
+    // A leftover chunk too small for the request is replaced, so the chain
+    // stays as long as the largest command needed and doesn't keep growing.
+    arena_chunk_t* chunk = arena->current;
+    if (chunk->size - chunk->used < size) {
+        if (arena->reserved) {
+            return 0; // The reserved range is all there is
+        }
+        arena_chunk_t* next = chunk->next;
+        if (!next || next->size < size) {
+            arena_chunk_t* created = chunk_create(arena, size);
+            if (!created) {
+                return 0;
+            }
+            if (next) {
+                created->next = next->next;
+                free(next);
+            }
+            chunk->next = created;
+            next = created;
+        }
+        chunk = next;
+        chunk->used = 0;
+    }
+    arena->current = chunk;
+
+    void* ptr = chunk_data(chunk) + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+void arena_reset(arena_t* arena) {
+    // Later chunks are cleared when arena_alloc moves on to them
+    arena->current = arena->first;
+    if (arena->first) {
+        if (arena->reserved) {
+            release_tail(arena);
+        }
+        arena->first->used = 0;
+    }
+}
+
+void arena_destroy(arena_t* arena) {
+    if (arena->reserved) {
+        vm_release((u32)arena->first);
+        arena->first = 0;
+        arena->current = 0;
+        arena->reserved = 0;
+        return;
+    }
+    arena_chunk_t* chunk = arena->first;
+    while (chunk) {
+        arena_chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->first = 0;
+    arena->current = 0;
+}
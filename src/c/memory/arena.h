@@ -0,0 +1,44 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "kernel/kernel.h"
+
+#define ARENA_ALIGNMENT 8
+
+// Arena chunk: a heap block that allocations are carved from front to back
+typedef struct arena_chunk {
+    struct arena_chunk* next;    // Next chunk, kept across resets
+    u32 size;                    // Usable bytes after the chunk header
+    u32 used;                    // Bytes handed out from this chunk
+} arena_chunk_t;
+
+// Arena (bump-pointer allocator) for short-lived memory that is released all at once.
+// Chunks come from malloc on first use and are reused after every reset.
+typedef struct {
+    arena_chunk_t* first;        // First chunk, 0 until the first allocation
+    arena_chunk_t* current;      // Chunk allocations are served from
+    u32 chunk_size;              // Usable size of a regular chunk
+    u32 reserved;                // Size of the virtual memory range the only chunk spans, 0 for heap chunks
+} arena_t;
+
+// Initialize an empty arena, chunk_size is the usual size of its chunks
+void arena_init(arena_t* arena, u32 chunk_size);
+
+// Initialize an arena that is one chunk spanning reserve_size bytes of
+// reserved virtual memory, committed but only backed by frames as it is
+// touched. Allocations beyond reserve_size fail. Every reset gives the frames
+// past the first chunk_size bytes back. Without room for the range the arena
+// is set up with heap chunks like arena_init does.
+void arena_init_reserved(arena_t* arena, u32 chunk_size, u32 reserve_size);
+
+// Allocate size bytes (8-byte aligned), 0 if out of memory. There is no
+// per-object free, everything goes away with arena_reset.
+void* arena_alloc(arena_t* arena, u32 size);
+
+// Release everything allocated from the arena in O(1), the chunks stay for reuse
+void arena_reset(arena_t* arena);
+
+// Give all chunks back to the heap (or release the reserved range)
+void arena_destroy(arena_t* arena);
+
+#endif
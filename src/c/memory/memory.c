@@ -1,11 +1,16 @@
 #include "memory/memory.h"
+#include "memory/pmm.h"
 #include "drivers/vga/vga.h"
+#include "libk/mem.h"
+#include "libk/printf.h"
+
+#define MEMORY_RATIO_SIZE 16           // "4294967295.99" and the terminator
 
 static memory_manager_t memory_manager;
 
-// Helper function to align size to 4-byte boundary
+// Helper function to align size to the block granularity
 static u32 align_size(u32 size) {
-    return (size + 3) & ~3;
+    return (size + MEMORY_BLOCK_ALIGNMENT - 1) & ~(MEMORY_BLOCK_ALIGNMENT - 1);
 }
 
 // Helper function to get block from pointer
@@ -18,125 +23,447 @@ static void* block_to_ptr(memory_block_t* block) {
     return (void*)((u8*)block + sizeof(memory_block_t));
 }
 
+// Helper function to get block size (including header)
+static u32 get_block_size(memory_block_t* block) {
+    return block->size_flags & ~MEMORY_BLOCK_FLAGS_MASK;
+}
+
 // Helper function to get block size (excluding header)
 static u32 get_block_data_size(memory_block_t* block) {
-    return block->size - sizeof(memory_block_t);
+    return get_block_size(block) - sizeof(memory_block_t);
 }
 
-// Helper function to split block if it's too large
-static void split_block(memory_block_t* block, u32 requested_size) {
-    u32 total_size = requested_size + sizeof(memory_block_t);
-    
-    if (block->size > total_size + sizeof(memory_block_t)) {
-        // Create new free block after the allocated block
-        memory_block_t* new_block = (memory_block_t*)((u8*)block + total_size);
-        new_block->size = block->size - total_size;
-        new_block->is_free = true;
-        new_block->next = block->next;
-        new_block->prev = block;
-        
-        // Update block sizes
-        block->size = total_size;
-        
-        // Update linked list
-        if (block->next) {
-            block->next->prev = new_block;
-        }
-        block->next = new_block;
-        
-        // Update memory manager
+// Helper function to check whether block is free
+static bool is_block_free(memory_block_t* block) {
+    return (block->size_flags & MEMORY_BLOCK_FREE) != 0;
+}
+
+// Helper function to get the physically next block
+static memory_block_t* next_block(memory_block_t* block) {
+    return (memory_block_t*)((u8*)block + get_block_size(block));
+}
+
+// Helper function to get the physically previous block.
+// Only valid when MEMORY_BLOCK_PREV_FREE is set, as only free blocks have a footer.
+static memory_block_t* prev_block(memory_block_t* block) {
+    u32 prev_size = *((u32*)block - 1);
+    return (memory_block_t*)((u8*)block - prev_size);
+}
+
+// Helper function to get free list links of a free block
+static memory_free_links_t* block_links(memory_block_t* block) {
+    return (memory_free_links_t*)block_to_ptr(block);
+}
+
+// Helper function to move the fresh memory watermark past a block handed out to
+// a caller, including the header and free list links a split may put behind it
+static void touch_block(memory_block_t* block) {
+    u32 written_end = (u32)next_block(block) + sizeof(memory_block_t) + sizeof(memory_free_links_t);
+    if (written_end > memory_manager.fresh_start) {
+        memory_manager.fresh_start = written_end;
+    }
+}
+
+// Helper function to turn block into a free block of the given size:
+// writes header and footer and tells the next block that its neighbour is free
+static void make_free_block(memory_block_t* block, u32 size) {
+    block->size_flags = size | MEMORY_BLOCK_FREE;
+    *(u32*)((u8*)block + size - sizeof(u32)) = size;
+    next_block(block)->size_flags |= MEMORY_BLOCK_PREV_FREE;
+}
+
+// Helper function to map block size to its size-class bin (floor(log2(size)))
+static u32 size_to_bin(u32 size) {
+    return 31 - __builtin_clz(size);
+}
+
+// Helper function to put a free block at the head of its bin
+static void insert_free_block(memory_block_t* block) {
+    u32 bin = size_to_bin(get_block_size(block));
+    memory_free_links_t* links = block_links(block);
+
+    links->prev_free = 0;
+    links->next_free = memory_manager.free_bins[bin];
+    if (links->next_free) {
+        block_links(links->next_free)->prev_free = block;
+    }
+    memory_manager.free_bins[bin] = block;
+    memory_manager.free_bins_bitmap |= (1u << bin);
+}
+
+// Helper function to unlink a free block from its bin
+static void remove_free_block(memory_block_t* block) {
+    u32 bin = size_to_bin(get_block_size(block));
+    memory_free_links_t* links = block_links(block);
+
+    if (links->prev_free) {
+        block_links(links->prev_free)->next_free = links->next_free;
+    } else {
+        memory_manager.free_bins[bin] = links->next_free;
+    }
+    if (links->next_free) {
+        block_links(links->next_free)->prev_free = links->prev_free;
+    }
+    if (!memory_manager.free_bins[bin]) {
+        memory_manager.free_bins_bitmap &= ~(1u << bin);
+    }
+}
+
+// Helper function to find a free block of at least total_size bytes
+static memory_block_t* find_free_block(u32 total_size) {
+    u32 bin = size_to_bin(total_size);
+    memory_manager.profile.searches++;
+
+    // Blocks in the request's own bin may be smaller than requested,
+    // so only its head is probed; this keeps small requests a good fit.
+    memory_block_t* head = memory_manager.free_bins[bin];
+    memory_manager.profile.search_steps++;
+    if (head && get_block_size(head) >= total_size) {
+        return head;
+    }
+
+    // Any block in a higher bin is large enough: take the first non-empty one
+    if (bin + 1 >= MEMORY_BIN_COUNT) {
+        return 0;
+    }
+    u32 candidates = memory_manager.free_bins_bitmap & (~0u << (bin + 1));
+    if (!candidates) {
+        return 0;
+    }
+    memory_manager.profile.search_steps++;
+    return memory_manager.free_bins[__builtin_ctz(candidates)];
+}
+
+// Helper function to mark a free (already unbinned) block as allocated,
+// splitting off the tail as a new free block if it's too large
+static void allocate_block(memory_block_t* block, u32 total_size) {
+    u32 block_size = get_block_size(block);
+    u32 prev_free = block->size_flags & MEMORY_BLOCK_PREV_FREE;
+
+    // Only aligned_alloc leaves a free block in front of an allocated one
+    if (block_size - total_size >= MEMORY_MIN_BLOCK_SIZE) {
+        block->size_flags = total_size | prev_free;
+        make_free_block(next_block(block), block_size - total_size);
+        insert_free_block(next_block(block));
         memory_manager.block_count++;
-        memory_manager.free_memory += new_block->size;
+    } else {
+        block->size_flags = block_size | prev_free;
+        next_block(block)->size_flags &= ~MEMORY_BLOCK_PREV_FREE;
     }
+
+    memory_manager.allocated_memory += get_block_size(block);
+    memory_manager.free_memory -= get_block_size(block);
+    if (memory_manager.allocated_memory > memory_manager.profile.peak_allocated) {
+        memory_manager.profile.peak_allocated = memory_manager.allocated_memory;
+    }
+    touch_block(block);
 }
 
-// Helper function to merge adjacent free blocks
-static void merge_free_blocks(memory_block_t* block) {
-    // Merge with next block if it's free
-    if (block->next && block->next->is_free) {
-        memory_block_t* next_block = block->next;
-        block->size += next_block->size;
-        block->next = next_block->next;
-        
-        if (next_block->next) {
-            next_block->next->prev = block;
-        }
-        
+// Helper function to count an allocation request of size bytes in the profile
+static void profile_allocation(u32 size, void* result) {
+    u32 bucket = size ? 31 - __builtin_clz(size) : 0;
+    if (bucket >= MEMORY_HISTOGRAM_BUCKETS) {
+        bucket = MEMORY_HISTOGRAM_BUCKETS - 1;
+    }
+    memory_manager.profile.size_histogram[bucket]++;
+    if (result) {
+        memory_manager.profile.allocations++;
+    } else {
+        memory_manager.profile.failures++;
+    }
+}
+
+// Helper function to get the tag word of a tagged block
+static u32* block_tag_word(memory_block_t* block) {
+    return (u32*)next_block(block) - 1;
+}
+
+// Helper function to turn a not yet binned block of the given size into a free block:
+// coalesces it with free neighbours through the boundary tags and bins the result
+static memory_block_t* release_block(memory_block_t* block, u32 size) {
+    // Coalesce with the next block using its header
+    memory_block_t* next = (memory_block_t*)((u8*)block + size);
+    if (is_block_free(next)) {
+        remove_free_block(next);
+        size += get_block_size(next);
         memory_manager.block_count--;
-        memory_manager.free_memory += sizeof(memory_block_t);
     }
-    
-    // Merge with previous block if it's free
-    if (block->prev && block->prev->is_free) {
-        memory_block_t* prev_block = block->prev;
-        prev_block->size += block->size;
-        prev_block->next = block->next;
-        
-        if (block->next) {
-            block->next->prev = prev_block;
-        }
-        
+
+    // Coalesce with the previous block using its footer
+    if (block->size_flags & MEMORY_BLOCK_PREV_FREE) {
+        memory_block_t* prev = prev_block(block);
+        remove_free_block(prev);
+        size += get_block_size(prev);
         memory_manager.block_count--;
-        memory_manager.free_memory += sizeof(memory_block_t);
+        block = prev;
     }
+
+    make_free_block(block, size);
+    insert_free_block(block);
+    return block;
+}
+
+// Helper function to extend the heap in place with frames right after its end
+static bool grow_heap(u32 min_size) {
+    u32 grow_size = (min_size + PMM_FRAME_SIZE - 1) & ~(PMM_FRAME_SIZE - 1);
+    if (grow_size < MEMORY_GROW_MIN_SIZE) {
+        grow_size = MEMORY_GROW_MIN_SIZE;
+    }
+    if (!pmm_claim_frames(VIRT_TO_PHYS(memory_manager.region_end), grow_size / PMM_FRAME_SIZE)) {
+        return false;
+    }
+
+    // New frames are cleared once here so that calloc can skip them later
+    memset((void*)memory_manager.region_end, 0, grow_size);
+    memory_manager.region_end += grow_size;
+
+    // The old end marker becomes the header of a new free block
+    memory_block_t* block = memory_manager.heap_end;
+    memory_manager.heap_end = (memory_block_t*)((u8*)block + grow_size);
+    memory_manager.heap_end->size_flags = 0;
+
+    memory_manager.total_heap_size += grow_size;
+    memory_manager.free_memory += grow_size;
+    memory_manager.block_count++;
+    memory_manager.profile.heap_grows++;
+    if (release_block(block, grow_size) != block) {
+        // Merged into the last block: its old footer and the old end marker
+        // are now in the middle of fresh memory
+        block->size_flags = 0;
+        *((u32*)block - 1) = 0;
+    }
+    return true;
+}
+
+// Helper function to give frames at the end of the heap back once the free
+// block there passes the high watermark, keeping the low watermark free
+static void shrink_heap(memory_block_t* last) {
+    if (get_block_size(last) < MEMORY_SHRINK_HIGH_WATERMARK) {
+        return;
+    }
+
+    u32 region_end = ((u32)last + MEMORY_SHRINK_LOW_WATERMARK + PMM_FRAME_SIZE - 1) & ~(PMM_FRAME_SIZE - 1);
+    if (region_end < memory_manager.region_start + memory_manager.min_region_size) {
+        region_end = memory_manager.region_start + memory_manager.min_region_size;
+    }
+    if (region_end >= memory_manager.region_end) {
+        return;
+    }
+
+    // Same end marker placement as in memory_init
+    u32 first_block_addr = (u32)memory_manager.heap_start;
+    u32 end_marker_addr = first_block_addr + ((region_end - sizeof(memory_block_t) - first_block_addr) & ~(MEMORY_BLOCK_ALIGNMENT - 1));
+    u32 last_size = end_marker_addr - (u32)last;
+    if (end_marker_addr < (u32)last || last_size < MEMORY_MIN_BLOCK_SIZE) {
+        return;
+    }
+    u32 released = (u32)memory_manager.heap_end - end_marker_addr;
+
+    remove_free_block(last);
+    memory_manager.heap_end = (memory_block_t*)end_marker_addr;
+    memory_manager.heap_end->size_flags = 0;
+    make_free_block(last, last_size);
+    insert_free_block(last);
+
+    memory_manager.total_heap_size -= released;
+    memory_manager.free_memory -= released;
+    memory_manager.profile.heap_shrinks++;
+    pmm_free_frames(VIRT_TO_PHYS(region_end), (memory_manager.region_end - region_end) / PMM_FRAME_SIZE);
+    memory_manager.region_end = region_end;
+}
+
+// Helper function to find a free block of at least total_size bytes, growing or
+// compacting the heap if none fits. Compaction only helps with enough free memory in total.
+static memory_block_t* find_or_grow(u32 total_size) {
+    memory_block_t* block = find_free_block(total_size);
+    if (!block && grow_heap(total_size)) {
+        block = find_free_block(total_size);
+    }
+    if (!block && memory_manager.handle_count > 0 && memory_manager.free_memory >= total_size &&
+        memory_defragment() > 0) {
+        block = find_free_block(total_size);
+    }
+    return block;
+}
+
+// Helper function to compute the block size needed for size bytes of data.
+// A freed block must be able to hold the free list links and the footer.
+static u32 request_to_block_size(u32 size) {
+    u32 total_size = align_size(size + sizeof(memory_block_t));
+    if (total_size < MEMORY_MIN_BLOCK_SIZE) {
+        total_size = MEMORY_MIN_BLOCK_SIZE;
+    }
+    return total_size;
+}
+
+// Helper function to get the allocated block behind a caller's pointer, 0 if there is none
+static memory_block_t* lookup_block(void* ptr) {
+    memory_block_t* block = ptr_to_block(ptr);
+    if (block < memory_manager.heap_start || block >= memory_manager.heap_end) {
+        return 0; // Invalid pointer
+    }
+    if (is_block_free(block)) {
+        return 0; // Already free
+    }
+    return block;
+}
+
+// Helper function to give the tail of an allocated block back to the heap
+// when it's large enough to be a block of its own
+static void trim_block(memory_block_t* block, u32 total_size) {
+    u32 block_size = get_block_size(block);
+    if (block_size - total_size < MEMORY_MIN_BLOCK_SIZE) {
+        return;
+    }
+
+    block->size_flags = total_size | (block->size_flags & (MEMORY_BLOCK_PREV_FREE | MEMORY_BLOCK_TAGGED));
+    memory_block_t* tail = next_block(block);
+    tail->size_flags = block_size - total_size;
+    memory_manager.allocated_memory -= block_size - total_size;
+    memory_manager.free_memory += block_size - total_size;
+    memory_manager.block_count++;
+
+    tail = release_block(tail, block_size - total_size);
+    if (next_block(tail) == memory_manager.heap_end) {
+        shrink_heap(tail);
+    }
+}
+
+// Helper function to grow an allocated block in place to at least total_size
+// bytes by taking over the free block behind it. Returns false if it doesn't fit.
+static bool extend_block(memory_block_t* block, u32 total_size) {
+    u32 block_size = get_block_size(block);
+    memory_block_t* next = next_block(block);
+
+    // A block at the end of the heap can grow together with the heap
+    u32 available = block_size + (is_block_free(next) ? get_block_size(next) : 0);
+    bool at_heap_end = next == memory_manager.heap_end ||
+                       (is_block_free(next) && next_block(next) == memory_manager.heap_end);
+    if (available < total_size && at_heap_end && grow_heap(total_size - available)) {
+        next = next_block(block);
+        available = block_size + get_block_size(next);
+    }
+    if (available < total_size) {
+        return false;
+    }
+
+    u32 next_size = get_block_size(next);
+    remove_free_block(next);
+    block->size_flags = (block_size + next_size) | (block->size_flags & (MEMORY_BLOCK_PREV_FREE | MEMORY_BLOCK_TAGGED));
+    next_block(block)->size_flags &= ~MEMORY_BLOCK_PREV_FREE;
+    memory_manager.allocated_memory += next_size;
+    memory_manager.free_memory -= next_size;
+    memory_manager.block_count--;
+
+    trim_block(block, total_size);
+    touch_block(block);
+    return true;
 }
 
 void memory_init(u32 heap_start_addr, u32 heap_size) {
+    // The first header sits 4 bytes below an 8-byte boundary so that every
+    // data area is 8-byte aligned; the last 4 bytes hold the end marker.
+    u32 first_block_addr = align_size(heap_start_addr + sizeof(memory_block_t)) - sizeof(memory_block_t);
+    u32 heap_end_addr = heap_start_addr + heap_size - sizeof(memory_block_t);
+    u32 blocks_size = 0;
+    if (heap_end_addr > first_block_addr) {
+        blocks_size = (heap_end_addr - first_block_addr) & ~(MEMORY_BLOCK_ALIGNMENT - 1);
+    }
+    u32 end_marker_addr = first_block_addr + blocks_size;
+
     // Initialize memory manager
-    memory_manager.heap_start = (memory_block_t*)heap_start_addr;
-    memory_manager.heap_end = (memory_block_t*)(heap_start_addr + heap_size);
-    memory_manager.total_heap_size = heap_size;
-    memory_manager.free_memory = heap_size;
+    memory_manager.heap_start = (memory_block_t*)first_block_addr;
+    memory_manager.heap_end = (memory_block_t*)end_marker_addr;
+    memory_manager.region_start = heap_start_addr;
+    memory_manager.region_end = heap_start_addr + heap_size;
+    memory_manager.min_region_size = heap_size;
+    memory_manager.fresh_start = first_block_addr;
+    memory_manager.total_heap_size = blocks_size;
+    memory_manager.free_memory = 0;
     memory_manager.allocated_memory = 0;
-    memory_manager.block_count = 1;
+    memory_manager.block_count = 0;
+    memory_manager.free_bins_bitmap = 0;
+    for (u32 i = 0; i < MEMORY_BIN_COUNT; i++) {
+        memory_manager.free_bins[i] = 0;
+    }
+    for (u32 i = 0; i < MEMORY_MAX_HANDLES; i++) {
+        memory_manager.handles[i].block = 0;
+        memory_manager.handles[i].lock_count = 0;
+    }
+    memory_manager.handle_count = 0;
+    memset(&memory_manager.profile, 0, sizeof(memory_profile_t));
     
+    // Clear the heap once so that calloc only has to clear reused memory
+    memset((void*)heap_start_addr, 0, heap_size);
+
+    // Zero-sized allocated block marks the end of the heap and stops coalescing
+    memory_manager.heap_end->size_flags = 0;
+
     // Initialize the initial free block
-    memory_block_t* initial_block = memory_manager.heap_start;
-    initial_block->size = heap_size;
-    initial_block->is_free = true;
-    initial_block->next = 0;
-    initial_block->prev = 0;
+    if (blocks_size >= MEMORY_MIN_BLOCK_SIZE) {
+        make_free_block(memory_manager.heap_start, blocks_size);
+        insert_free_block(memory_manager.heap_start);
+        memory_manager.free_memory = blocks_size;
+        memory_manager.block_count = 1;
+    }
 }
 
 void* malloc(u32 size) {
     if (size == 0) {
         return 0;
     }
+    if (size > MEMORY_MAX_ALLOCATION) {
+        profile_allocation(size, 0);
+        return 0;
+    }
     
-    // Align size to 4-byte boundary
-    u32 aligned_size = align_size(size);
-    u32 total_size = aligned_size + sizeof(memory_block_t);
-    
-    // Find the largest free block (worst fit)
-    memory_block_t* worst_block = 0;
-    memory_block_t* current = memory_manager.heap_start;
+    u32 total_size = request_to_block_size(size);
     
-    while (current) {
-        if (current->is_free && current->size >= total_size) {
-            if (!worst_block || current->size > worst_block->size) {
-                worst_block = current;
-            }
-        }
-        current = current->next;
-    }
+    // Look the block up in the size-class bins, growing the heap if none fits
+    memory_block_t* block = find_or_grow(total_size);
     
-    if (!worst_block) {
+    if (!block) {
         // No suitable block found
+        profile_allocation(size, 0);
         return 0;
     }
     
-    // Mark block as allocated
-    worst_block->is_free = false;
-    
-    // Update memory statistics
-    memory_manager.allocated_memory += worst_block->size;
-    memory_manager.free_memory -= worst_block->size;
-    
-    // Split block if it's too large
-    split_block(worst_block, aligned_size);
+    remove_free_block(block);
+    allocate_block(block, total_size);
+    profile_allocation(size, block);
     
     // Return pointer to data area
-    return block_to_ptr(worst_block);
+    return block_to_ptr(block);
+}
+
+void* malloc_tagged_at(u32 size, const char* file, u32 line) {
+    // Call sites are few, a linear lookup is cheap enough
+    memory_profile_t* profile = &memory_manager.profile;
+    u32 tag = 0;
+    while (tag < profile->tag_count && (profile->tags[tag].line != line || profile->tags[tag].file != file)) {
+        tag++;
+    }
+    if (tag == MEMORY_MAX_TAGS) {
+        return malloc(size); // Tag table full, allocate untracked
+    }
+    if (tag == profile->tag_count) {
+        profile->tags[tag].file = file;
+        profile->tags[tag].line = line;
+        profile->tag_count++;
+    }
+
+    // One extra word at the end of the block holds the tag
+    u8* ptr = size <= MEMORY_MAX_ALLOCATION ? malloc(size + sizeof(u32)) : 0;
+    if (!ptr) {
+        profile->tags[tag].failures++;
+        return 0;
+    }
+    memory_block_t* block = ptr_to_block(ptr);
+    block->size_flags |= MEMORY_BLOCK_TAGGED;
+    *block_tag_word(block) = (tag << 24) | (profile->allocations & MEMORY_TAG_CLOCK_MASK);
+    profile->tags[tag].allocations++;
+    profile->tags[tag].live_bytes += get_block_data_size(block) - sizeof(u32);
+    return ptr;
 }
 
 void free(void* ptr) {
@@ -145,26 +472,159 @@ void free(void* ptr) {
     }
     
     // Get block from pointer
-    memory_block_t* block = ptr_to_block(ptr);
-    
-    // Check if block is valid
-    if (block < memory_manager.heap_start || block >= memory_manager.heap_end) {
-        return; // Invalid pointer
+    memory_block_t* block = lookup_block(ptr);
+    if (!block) {
+        return;
     }
     
-    if (block->is_free) {
-        return; // Already free
+    u32 size = get_block_size(block);
+
+    if (block->size_flags & MEMORY_BLOCK_TAGGED) {
+        u32 tag_word = *block_tag_word(block);
+        memory_tag_t* tag = &memory_manager.profile.tags[tag_word >> 24];
+        tag->frees++;
+        tag->live_bytes -= get_block_data_size(block) - sizeof(u32);
+        tag->lifetime_total += (memory_manager.profile.allocations - tag_word) & MEMORY_TAG_CLOCK_MASK;
     }
-    
-    // Mark block as free
-    block->is_free = true;
-    
+
     // Update memory statistics
-    memory_manager.allocated_memory -= block->size;
-    memory_manager.free_memory += block->size;
+    memory_manager.allocated_memory -= size;
+    memory_manager.free_memory += size;
+    memory_manager.profile.frees++;
     
-    // Merge with adjacent free blocks
-    merge_free_blocks(block);
+    // Merge with free neighbours, then hand trailing frames back if possible
+    block = release_block(block, size);
+    if (next_block(block) == memory_manager.heap_end) {
+        shrink_heap(block);
+    }
+}
+
+void* calloc(u32 count, u32 size) {
+    if (size != 0 && count > 0xFFFFFFFF / size) {
+        return 0;
+    }
+
+    // Memory above the watermark has never been handed out and is still zero
+    u32 fresh_start = memory_manager.fresh_start;
+    u32* data = (u32*)malloc(count * size);
+    if (!data) {
+        return 0;
+    }
+
+    memory_block_t* block = ptr_to_block(data);
+    u32* data_end = (u32*)next_block(block);
+    u32* zero_end = (u32)data_end < fresh_start ? data_end : (u32*)fresh_start;
+
+    // Free list links and the footer of the block it was carved from
+    // may lie above the watermark, clear them in any case
+    if (zero_end < data + 2) {
+        zero_end = data + 2;
+    }
+    memset(data, 0, (u32)zero_end - (u32)data);
+    data_end[-1] = 0;
+    return data;
+}
+
+// Helper function to resize an allocated block to hold size bytes,
+// in place if possible. Returns the (maybe moved) block or 0 if out of memory.
+static memory_block_t* resize_block(memory_block_t* block, u32 size) {
+    u32 total_size = request_to_block_size(size);
+    if (total_size <= get_block_size(block)) {
+        trim_block(block, total_size);
+        return block;
+    }
+    if (extend_block(block, total_size)) {
+        return block;
+    }
+
+    // No room behind the block: move it
+    void* new_ptr = malloc(size);
+    if (!new_ptr) {
+        return 0;
+    }
+    memcpy(new_ptr, block_to_ptr(block), get_block_data_size(block));
+    block->size_flags &= ~MEMORY_BLOCK_TAGGED; // The tag moves with the data
+    free(block_to_ptr(block));
+    return ptr_to_block(new_ptr);
+}
+
+void* realloc(void* ptr, u32 size) {
+    if (!ptr) {
+        return malloc(size);
+    }
+    if (size == 0) {
+        free(ptr);
+        return 0;
+    }
+
+    memory_block_t* block = lookup_block(ptr);
+    if (!block || size > MEMORY_MAX_ALLOCATION) {
+        return 0;
+    }
+    if (!(block->size_flags & MEMORY_BLOCK_TAGGED)) {
+        block = resize_block(block, size);
+        return block ? block_to_ptr(block) : 0;
+    }
+
+    // Tagged blocks keep their tag word behind the data
+    u32 tag_word = *block_tag_word(block);
+    memory_tag_t* tag = &memory_manager.profile.tags[tag_word >> 24];
+    tag->live_bytes -= get_block_data_size(block) - sizeof(u32);
+    memory_block_t* resized = resize_block(block, size + sizeof(u32));
+    if (resized) {
+        block = resized;
+        block->size_flags |= MEMORY_BLOCK_TAGGED;
+        *block_tag_word(block) = tag_word;
+    }
+    tag->live_bytes += get_block_data_size(block) - sizeof(u32);
+    return resized ? block_to_ptr(resized) : 0;
+}
+
+void* aligned_alloc(u32 alignment, u32 size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment > MEMORY_MAX_ALLOCATION) {
+        return 0;
+    }
+    if (alignment <= MEMORY_BLOCK_ALIGNMENT) {
+        return malloc(size);
+    }
+    if (size == 0) {
+        return 0;
+    }
+    if (size > MEMORY_MAX_ALLOCATION) {
+        profile_allocation(size, 0);
+        return 0;
+    }
+
+    // Room to move the data area up to the alignment while leaving
+    // either nothing or a whole free block in front of it
+    u32 total_size = request_to_block_size(size);
+    memory_block_t* block = find_or_grow(total_size + alignment + MEMORY_MIN_BLOCK_SIZE);
+    if (!block) {
+        profile_allocation(size, 0);
+        return 0;
+    }
+    remove_free_block(block);
+
+    u32 data = ((u32)block_to_ptr(block) + alignment - 1) & ~(alignment - 1);
+    u32 front_size = data - (u32)block_to_ptr(block);
+    if (front_size != 0 && front_size < MEMORY_MIN_BLOCK_SIZE) {
+        data += alignment;
+        front_size += alignment;
+    }
+
+    if (front_size != 0) {
+        // Split the unaligned front off as a free block of its own
+        memory_block_t* aligned = ptr_to_block((void*)data);
+        aligned->size_flags = get_block_size(block) - front_size;
+        make_free_block(block, front_size);
+        insert_free_block(block);
+        memory_manager.block_count++;
+        block = aligned;
+    }
+
+    allocate_block(block, total_size);
+    profile_allocation(size, block);
+    return block_to_ptr(block);
 }
 
 void memory_get_stats(u32* total, u32* free, u32* allocated, u32* blocks) {
@@ -174,82 +634,247 @@ void memory_get_stats(u32* total, u32* free, u32* allocated, u32* blocks) {
     if (blocks) *blocks = memory_manager.block_count;
 }
 
-void memory_print_map() {
-    vga_print_color("Memory Map:\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
-    vga_print_color("Address    Size      Status\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
-    vga_print_color("---------- --------- --------\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
-    
-    memory_block_t* current = memory_manager.heap_start;
-    u32 address = (u32)memory_manager.heap_start;
-    
-    while (current) {
-        // Print address
-        char addr_str[12];
-        u32 temp_addr = address;
-        u8 addr_len = 0;
-        while (temp_addr > 0 && addr_len < 10) {
-            addr_str[addr_len] = '0' + (temp_addr % 10);
-            temp_addr /= 10;
-            addr_len++;
-        }
-        addr_str[addr_len] = '\0';
-        
-        // Reverse address string
-        for (u8 i = 0; i < addr_len / 2; i++) {
-            char temp = addr_str[i];
-            addr_str[i] = addr_str[addr_len - 1 - i];
-            addr_str[addr_len - 1 - i] = temp;
+u32 memory_get_largest_free_block() {
+    if (!memory_manager.free_bins_bitmap) {
+        return 0;
+    }
+
+    // The largest block lives in the highest non-empty bin
+    u32 bin = 31 - __builtin_clz(memory_manager.free_bins_bitmap);
+    u32 largest = 0;
+    for (memory_block_t* block = memory_manager.free_bins[bin]; block; block = block_links(block)->next_free) {
+        if (get_block_size(block) > largest) {
+            largest = get_block_size(block);
         }
-        
-        vga_print_color(addr_str, VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
-        vga_print_color("  ", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
-        
-        // Print size
-        char size_str[12];
-        u32 temp_size = current->size;
-        u8 size_len = 0;
-        while (temp_size > 0 && size_len < 10) {
-            size_str[size_len] = '0' + (temp_size % 10);
-            temp_size /= 10;
-            size_len++;
+    }
+    return largest;
+}
+
+u32 memory_get_fragmentation() {
+    if (memory_manager.free_memory == 0) {
+        return 0;
+    }
+    u32 largest = memory_get_largest_free_block();
+    u32 total_free = memory_manager.free_memory;
+
+    // Scale both down so that largest * 100 cannot overflow
+    while (total_free > 0xFFFFFFFF / 100) {
+        total_free >>= 1;
+        largest >>= 1;
+    }
+    return 100 - (largest * 100) / total_free;
+}
+
+// Helper function to format numerator / denominator with two decimals
+static void format_ratio(char* buffer, u32 size, u32 numerator, u32 denominator) {
+    if (denominator == 0) {
+        ksnprintf(buffer, size, "-");
+        return;
+    }
+    // Scale both down so that the remainder * 100 cannot overflow
+    while (denominator > 0xFFFFFFFF / 100) {
+        numerator >>= 1;
+        denominator >>= 1;
+    }
+    u32 hundredths = (numerator % denominator) * 100 / denominator;
+    ksnprintf(buffer, size, "%u.%02u", numerator / denominator, hundredths);
+}
+
+const memory_profile_t* memory_get_profile() {
+    return &memory_manager.profile;
+}
+
+void memory_print_profile(bool to_serial) {
+    u32 targets = to_serial ? KPRINTF_SERIAL : KPRINTF_VGA;
+    const memory_profile_t* profile = &memory_manager.profile;
+    char ratio[MEMORY_RATIO_SIZE];
+
+    format_ratio(ratio, sizeof(ratio), profile->search_steps, profile->searches);
+    kprintf_to(targets, VGA_DEFAULT_FG, VGA_DEFAULT_BG,
+               "Allocations: %u  Frees: %u  Failed: %u\n"
+               "Allocated: %u  Peak: %u  Heap: %u\n"
+               "Search length: %s  Heap grows: %u  Shrinks: %u\n"
+               "Compactions: %u  Blocks moved: %u  Handles: %u\n",
+               profile->allocations, profile->frees, profile->failures,
+               memory_manager.allocated_memory, profile->peak_allocated, memory_manager.total_heap_size,
+               ratio, profile->heap_grows, profile->heap_shrinks,
+               profile->compactions, profile->blocks_moved, memory_manager.handle_count);
+
+    // Only buckets that saw requests, as "from-to: count"
+    kprintf_to(targets, VGA_DEFAULT_FG, VGA_DEFAULT_BG, "Request sizes:");
+    for (u32 bucket = 0; bucket < MEMORY_HISTOGRAM_BUCKETS; bucket++) {
+        if (profile->size_histogram[bucket] == 0) {
+            continue;
         }
-        size_str[size_len] = '\0';
-        
-        // Reverse size string
-        for (u8 i = 0; i < size_len / 2; i++) {
-            char temp = size_str[i];
-            size_str[i] = size_str[size_len - 1 - i];
-            size_str[size_len - 1 - i] = temp;
+        if (bucket == MEMORY_HISTOGRAM_BUCKETS - 1) {
+            kprintf_to(targets, VGA_DEFAULT_FG, VGA_DEFAULT_BG, " %u+:%u", 1u << bucket, profile->size_histogram[bucket]);
+        } else {
+            kprintf_to(targets, VGA_DEFAULT_FG, VGA_DEFAULT_BG, " %u-%u:%u", 1u << bucket, (2u << bucket) - 1,
+                       profile->size_histogram[bucket]);
         }
-        
-        vga_print_color(size_str, VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
-        vga_print_color("  ", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    }
+    kprintf_to(targets, VGA_DEFAULT_FG, VGA_DEFAULT_BG, "\n");
+
+    for (u32 i = 0; i < profile->tag_count; i++) {
+        const memory_tag_t* tag = &profile->tags[i];
+        format_ratio(ratio, sizeof(ratio), tag->lifetime_total, tag->frees);
+        kprintf_to(targets, VGA_DEFAULT_FG, VGA_DEFAULT_BG, "%s:%u allocs %u frees %u failed %u live %u lifetime %s\n",
+                   tag->file, tag->line, tag->allocations, tag->frees, tag->failures, tag->live_bytes, ratio);
+    }
+}
+
+void memory_print_map() {
+    kprintf_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK, "Memory Map:\n");
+    kprintf_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK, "Address    Size      Status\n"
+                                                    "---------- --------- --------\n");
+    
+    for (memory_block_t* current = memory_manager.heap_start; current < memory_manager.heap_end; current = next_block(current)) {
+        kprintf("%p %-9u ", current, get_block_size(current));
         
         // Print status
-        if (current->is_free) {
-            vga_print_color("FREE", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+        if (is_block_free(current)) {
+            kprintf_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK, "FREE\n");
         } else {
-            vga_print_color("USED", VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+            kprintf_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK, "USED\n");
         }
-        
-        vga_newline();
-        
-        address += current->size;
-        current = current->next;
     }
     
-    vga_newline();
+    kprintf_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK, "Largest free block: ");
+    kprintf("%u", memory_get_largest_free_block());
+    kprintf_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK, "  Fragmentation: ");
+    kprintf("%u%%\n\n", memory_get_fragmentation());
 }
 
-void memory_defragment() {
-    // Simple defragmentation: merge all adjacent free blocks
-    memory_block_t* current = memory_manager.heap_start;
-    
-    while (current) {
-        if (current->is_free) {
-            merge_free_blocks(current);
-        }
-        current = current->next;
+// Helper function to get the handle of a movable block, 0 for any other block
+static handle_t block_handle(memory_block_t* block) {
+    memory_handle_prefix_t* prefix = (memory_handle_prefix_t*)block_to_ptr(block);
+    handle_t handle = prefix->handle;
+    if (prefix->magic != MEMORY_HANDLE_MAGIC ||
+        handle < memory_manager.handles || handle >= memory_manager.handles + MEMORY_MAX_HANDLES) {
+        return 0;
+    }
+    // Only the real owner is pointed at by its entry, data that merely looks like a prefix is not
+    return handle->block == block ? handle : 0;
+}
+
+handle_t halloc(u32 size) {
+    if (memory_manager.handle_count == MEMORY_MAX_HANDLES || size > MEMORY_MAX_ALLOCATION) {
+        return 0;
     }
+    handle_t handle = memory_manager.handles;
+    while (handle->block) {
+        handle++;
+    }
+
+    memory_handle_prefix_t* prefix = malloc(sizeof(memory_handle_prefix_t) + size);
+    if (!prefix) {
+        return 0;
+    }
+    prefix->handle = handle;
+    prefix->magic = MEMORY_HANDLE_MAGIC;
+    handle->block = ptr_to_block(prefix);
+    handle->lock_count = 0;
+    memory_manager.handle_count++;
+    return handle;
+}
+
+void* hlock(handle_t handle) {
+    if (!handle || !handle->block) {
+        return 0;
+    }
+    handle->lock_count++;
+    return (u8*)block_to_ptr(handle->block) + sizeof(memory_handle_prefix_t);
+}
+
+void hunlock(handle_t handle) {
+    if (handle && handle->lock_count > 0) {
+        handle->lock_count--;
+    }
+}
+
+bool hrealloc(handle_t handle, u32 size) {
+    if (!handle || !handle->block || handle->lock_count > 0 || size > MEMORY_MAX_ALLOCATION) {
+        return false;
+    }
+
+    // Pinned so that a compaction run inside realloc leaves this block alone
+    handle->lock_count++;
+    void* ptr = realloc(block_to_ptr(handle->block), sizeof(memory_handle_prefix_t) + size);
+    handle->lock_count--;
+    if (!ptr) {
+        return false;
+    }
+    handle->block = ptr_to_block(ptr);
+    return true;
 }
 
+void hfree(handle_t handle) {
+    if (!handle || !handle->block) {
+        return;
+    }
+    free(block_to_ptr(handle->block));
+    handle->block = 0;
+    handle->lock_count = 0;
+    memory_manager.handle_count--;
+}
+
+// Helper function to turn the gap the compactor left behind into a free block
+static void close_gap(memory_block_t* gap, u32 gap_size) {
+    make_free_block(gap, gap_size);
+    insert_free_block(gap);
+}
+
+u32 memory_defragment() {
+    // Sliding compaction in one pass over the heap. Free blocks are unbinned
+    // and joined into a gap, unlocked movable blocks are copied down to the
+    // start of the gap (so the gap moves up behind them) and every other
+    // allocated block ends the gap. Free blocks are never adjacent, so
+    // without movable blocks there is nothing to do.
+    memory_block_t* gap = 0;
+    u32 gap_size = 0;
+    u32 moved = 0;
+    u32 block_count = 0;
+
+    memory_block_t* block = memory_manager.heap_start;
+    while (block < memory_manager.heap_end) {
+        u32 size = get_block_size(block);
+        memory_block_t* next = next_block(block);
+        handle_t handle;
+
+        if (is_block_free(block)) {
+            remove_free_block(block);
+            if (!gap) {
+                gap = block;
+            }
+            gap_size += size;
+        } else if (gap && (handle = block_handle(block)) && handle->lock_count == 0) {
+            u32 flags = block->size_flags & MEMORY_BLOCK_TAGGED;
+            memmove(gap, block, size); // The gap may be smaller than the block
+            gap->size_flags = size | flags;
+            handle->block = gap;
+            gap = (memory_block_t*)((u8*)gap + size);
+            block_count++;
+            moved++;
+        } else {
+            if (gap) {
+                close_gap(gap, gap_size);
+                gap = 0;
+                gap_size = 0;
+                block_count++;
+            }
+            block_count++;
+        }
+        block = next;
+    }
+
+    if (gap) {
+        close_gap(gap, gap_size);
+        block_count++;
+        shrink_heap(gap);
+    }
+
+    memory_manager.block_count = block_count;
+    memory_manager.profile.compactions++;
+    memory_manager.profile.blocks_moved += moved;
+    return moved;
+}
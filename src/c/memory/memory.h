@@ -3,41 +3,177 @@
 
 #include "kernel/kernel.h"
 
-// Memory block structure
+// Number of size-class bins: bin N holds free blocks of size [2^N, 2^(N+1))
+#define MEMORY_BIN_COUNT 32
+
+// Larger requests fail up front, which keeps the size arithmetic from overflowing
+#define MEMORY_MAX_ALLOCATION 0x40000000
+
+// Heap growth and release, see grow_heap/shrink_heap
+#define MEMORY_GROW_MIN_SIZE 0x10000          // Grow by at least 64 KiB at a time
+#define MEMORY_SHRINK_HIGH_WATERMARK 0x40000  // Release frames once 256 KiB at the end are free
+#define MEMORY_SHRINK_LOW_WATERMARK 0x10000   // ...but keep 64 KiB free at the end
+
+// Blocks are multiples of 8 bytes, which leaves the low header bits for flags
+#define MEMORY_BLOCK_ALIGNMENT 8
+#define MEMORY_BLOCK_FREE 0x1        // Block is free
+#define MEMORY_BLOCK_PREV_FREE 0x2   // Physically previous block is free
+#define MEMORY_BLOCK_TAGGED 0x4      // Allocated by malloc_tagged, last word holds the tag
+#define MEMORY_BLOCK_FLAGS_MASK (MEMORY_BLOCK_ALIGNMENT - 1)
+
+// Memory block structure (boundary tag).
+// Allocated block: [header][data]
+// Free block:      [header][free list links][...][footer = size]
 typedef struct memory_block {
-    u32 size;                    // Size of the block (including header)
-    bool is_free;                // True if block is free, false if allocated
-    struct memory_block* next;   // Pointer to next block
-    struct memory_block* prev;   // Pointer to previous block
+    u32 size_flags;              // Size of the block (including header) | flags
 } memory_block_t;
 
+// Free list links, stored in the data area of free blocks only
+typedef struct {
+    memory_block_t* next_free;   // Next free block in the same bin
+    memory_block_t* prev_free;   // Previous free block in the same bin
+} memory_free_links_t;
+
+// Smallest block that can be freed: header, free list links and footer
+#define MEMORY_MIN_BLOCK_SIZE (sizeof(memory_block_t) + sizeof(memory_free_links_t) + sizeof(u32))
+
+// Movable allocations
+#define MEMORY_MAX_HANDLES 128
+#define MEMORY_HANDLE_MAGIC 0x4D4F5645  // "MOVE", marks the prefix of movable blocks
+
+// Handle table entry. A movable block starts with a memory_handle_prefix_t
+// pointing back at its entry, which is how the compactor finds the entry to update.
+typedef struct memory_handle {
+    memory_block_t* block;       // Current block, 0 if the entry is unused
+    u32 lock_count;              // Block must not move while this is not 0
+} memory_handle_entry_t;
+
+typedef memory_handle_entry_t* handle_t;
+
+// Hidden prefix in front of the data of movable blocks (keeps the data 8-byte aligned)
+typedef struct {
+    handle_t handle;
+    u32 magic;
+} memory_handle_prefix_t;
+
+// Allocation profiling
+#define MEMORY_HISTOGRAM_BUCKETS 16  // Bucket N counts requests of [2^N, 2^(N+1)) bytes, the last one the rest
+#define MEMORY_MAX_TAGS 32           // Distinct malloc_tagged call sites that are tracked
+#define MEMORY_TAG_CLOCK_MASK 0xFFFFFF  // Tag word: tag index in the top byte, allocation clock below
+
+// Counters of one malloc_tagged call site. Lifetimes are measured in allocations
+// made in between (the allocation clock), which needs no timer.
+typedef struct {
+    const char* file;
+    u32 line;
+    u32 allocations;             // Successful allocations
+    u32 frees;                   // Frees of blocks from this site
+    u32 failures;                // Failed allocations
+    u32 live_bytes;              // Usable bytes of blocks still allocated
+    u32 lifetime_total;          // Sum of lifetimes of freed blocks
+} memory_tag_t;
+
+// Always-on allocator counters
+typedef struct {
+    u32 allocations;             // Successful allocations, also the allocation clock
+    u32 frees;                   // Blocks freed
+    u32 failures;                // Allocations that returned 0
+    u32 peak_allocated;          // Highest allocated_memory seen
+    u32 searches;                // Free list searches
+    u32 search_steps;            // Free blocks and bins looked at by those searches
+    u32 heap_grows;              // Times the heap was extended
+    u32 heap_shrinks;            // Times frames were given back
+    u32 compactions;             // memory_defragment runs
+    u32 blocks_moved;            // Movable blocks moved by those runs
+    u32 size_histogram[MEMORY_HISTOGRAM_BUCKETS]; // Requested sizes
+    memory_tag_t tags[MEMORY_MAX_TAGS];
+    u32 tag_count;
+} memory_profile_t;
+
 // Memory manager structure
 typedef struct {
-    memory_block_t* heap_start;  // Start of heap
-    memory_block_t* heap_end;    // End of heap
-    u32 total_heap_size;         // Total heap size
+    memory_block_t* heap_start;  // First block of the heap
+    memory_block_t* heap_end;    // Zero-sized block marking the end of the heap
+    u32 region_start;            // Start of the frames backing the heap (direct map address)
+    u32 region_end;              // End of the frames backing the heap (direct map address)
+    u32 min_region_size;         // The heap never shrinks below its initial size
+    u32 fresh_start;             // Heap memory from here on was never handed out and is zero
+    u32 total_heap_size;         // Total size of all blocks
     u32 free_memory;             // Total free memory
     u32 allocated_memory;        // Total allocated memory
     u32 block_count;             // Number of blocks
+    memory_block_t* free_bins[MEMORY_BIN_COUNT]; // Heads of the size-class free lists
+    u32 free_bins_bitmap;        // Bit N is set when free_bins[N] is not empty
+    memory_profile_t profile;    // Allocation counters
+    memory_handle_entry_t handles[MEMORY_MAX_HANDLES]; // Entries of movable allocations
+    u32 handle_count;            // Number of entries in use
 } memory_manager_t;
 
 // Initialize memory manager
 void memory_init(u32 heap_start_addr, u32 heap_size);
 
-// Allocate memory using worst fit algorithm
+// Allocate memory using segregated fit (size-class free lists)
 void* malloc(u32 size);
 
 // Free allocated memory
 void free(void* ptr);
 
-// Get memory statistics
+// Allocate memory and account it to the calling file and line,
+// see memory_print_profile. Released with free() like any other block.
+#define malloc_tagged(size) malloc_tagged_at((size), __FILE__, __LINE__)
+void* malloc_tagged_at(u32 size, const char* file, u32 line);
+
+// Allocate zeroed memory for count objects of size bytes, 0 on overflow.
+// Memory that was never handed out is known to be zero and is not cleared again.
+void* calloc(u32 count, u32 size);
+
+// Resize an allocation. Grows in place when the block behind it is free (or is
+// the end of the heap), otherwise moves the data. ptr = 0 acts like malloc,
+// size = 0 like free. On failure returns 0 and leaves ptr untouched.
+void* realloc(void* ptr, u32 size);
+
+// Allocate memory whose address is a multiple of alignment (a power of two),
+// e.g. KMEM_CACHE_LINE_SIZE or PMM_FRAME_SIZE. Release it with free().
+void* aligned_alloc(u32 alignment, u32 size);
+
+// Allocate a movable block of size bytes, 0 if out of memory or handles.
+// The data has no fixed address: lock the handle to access it and unlock it
+// again so that memory_defragment may slide the block towards the heap start.
+handle_t halloc(u32 size);
+
+// Lock a movable block in place and get its data, locks nest
+void* hlock(handle_t handle);
+
+// Undo one hlock, pointers from hlock must not be used afterwards
+void hunlock(handle_t handle);
+
+// Resize a movable block, the block may move. Fails if the handle is locked.
+bool hrealloc(handle_t handle, u32 size);
+
+// Free a movable block and its handle
+void hfree(handle_t handle);
+
+// Get memory statistics (the heap grows and shrinks, so total changes over time)
 void memory_get_stats(u32* total, u32* free, u32* allocated, u32* blocks);
 
+// Get size of the largest free block (including header)
+u32 memory_get_largest_free_block();
+
+// Get external fragmentation in percent (0 = all free memory is one block)
+u32 memory_get_fragmentation();
+
+// Get allocation counters
+const memory_profile_t* memory_get_profile();
+
+// Print allocation counters, size histogram and call site tags, to VGA or to serial
+void memory_print_profile(bool to_serial);
+
 // Print memory map (for debugging)
 void memory_print_map();
 
-// Defragment memory
-void memory_defragment();
+// Compact the heap: slide unlocked movable blocks towards the heap start so the
+// free space between them joins into one block. Runs by itself when an
+// allocation finds no block large enough. Returns the number of blocks moved.
+u32 memory_defragment();
 
 #endif
-
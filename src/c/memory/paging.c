@@ -0,0 +1,100 @@
+#include "memory/paging.h"
+#include "memory/pmm.h"
+#include "libk/mem.h"
+
+#define PAGING_CPUID_FEATURE_PAT (1 << 16)  // cpuid leaf 1, edx
+#define PAGING_MSR_PAT 0x277
+#define PAGING_PAT_WRITE_COMBINING 0x01
+
+// Page directory set up by boot.asm
+extern u32 boot_page_directory[PAGE_ENTRIES];
+
+// Helper function to get the page table that maps the address, 0 if there is none.
+// Page tables come from the frame allocator and are reached through the direct map.
+static u32* get_page_table(u32 virtual_address) {
+    u32 entry = boot_page_directory[virtual_address >> 22];
+    if (!(entry & PAGE_PRESENT) || (entry & PAGE_LARGE)) {
+        return 0;
+    }
+    return (u32*)PHYS_TO_VIRT(entry & ~PAGE_FLAGS_MASK);
+}
+
+void paging_init() {
+    boot_page_directory[0] = 0;
+    load_page_directory(VIRT_TO_PHYS(boot_page_directory));
+}
+
+u32* paging_get_entry(u32 virtual_address, bool create) {
+    u32* directory_entry = &boot_page_directory[virtual_address >> 22];
+    if ((*directory_entry & PAGE_PRESENT) && (*directory_entry & PAGE_LARGE)) {
+        return 0;
+    }
+
+    if (!(*directory_entry & PAGE_PRESENT)) {
+        if (!create) {
+            return 0;
+        }
+        u32 table_frame = pmm_alloc_frame();
+        if (table_frame == 0) {
+            return 0;
+        }
+        memset((void*)PHYS_TO_VIRT(table_frame), 0, PAGE_SIZE);
+        // Access rights are decided per page, the directory entry allows everything
+        *directory_entry = table_frame | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+    }
+
+    return &get_page_table(virtual_address)[(virtual_address >> 12) & (PAGE_ENTRIES - 1)];
+}
+
+bool paging_enable_write_combining() {
+    u32 eax, ebx, ecx, edx;
+    read_cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & PAGING_CPUID_FEATURE_PAT)) {
+        return false;
+    }
+
+    // Entry 4 is write-back after reset like entry 0, and no page selects it yet,
+    // so no cached data or TLB entry depends on its old type
+    u32 low, high;
+    read_msr(PAGING_MSR_PAT, &low, &high);
+    high = (high & ~0xFF) | PAGING_PAT_WRITE_COMBINING;
+    write_msr(PAGING_MSR_PAT, low, high);
+    return true;
+}
+
+bool paging_map_page(u32 virtual_address, u32 physical_address, u32 flags) {
+    u32* entry = paging_get_entry(virtual_address, true);
+    if (!entry) {
+        return false;
+    }
+    *entry = (physical_address & ~PAGE_FLAGS_MASK) | (flags & PAGE_FLAGS_MASK) | PAGE_PRESENT;
+    invalidate_page(virtual_address);
+    return true;
+}
+
+u32 paging_unmap_page(u32 virtual_address) {
+    u32* entry = paging_get_entry(virtual_address, false);
+    if (!entry || !(*entry & PAGE_PRESENT)) {
+        return 0;
+    }
+    u32 physical_address = *entry & ~PAGE_FLAGS_MASK;
+    *entry = 0;
+    invalidate_page(virtual_address);
+    return physical_address;
+}
+
+u32 paging_get_physical(u32 virtual_address) {
+    u32 directory_entry = boot_page_directory[virtual_address >> 22];
+    if (!(directory_entry & PAGE_PRESENT)) {
+        return 0;
+    }
+    if (directory_entry & PAGE_LARGE) {
+        return (directory_entry & ~(PAGE_LARGE_SIZE - 1)) | (virtual_address & (PAGE_LARGE_SIZE - 1));
+    }
+
+    u32 entry = get_page_table(virtual_address)[(virtual_address >> 12) & (PAGE_ENTRIES - 1)];
+    if (!(entry & PAGE_PRESENT)) {
+        return 0;
+    }
+    return (entry & ~PAGE_FLAGS_MASK) | (virtual_address & PAGE_FLAGS_MASK);
+}
@@ -0,0 +1,54 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include "kernel/kernel.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_LARGE_SIZE 0x400000     // 4 MiB (PSE) page
+#define PAGE_ENTRIES 1024            // Entries in a page directory or page table
+
+// Page directory / page table entry flags
+#define PAGE_PRESENT 0x001
+#define PAGE_WRITABLE 0x002
+#define PAGE_USER 0x004
+#define PAGE_WRITE_THROUGH 0x008
+#define PAGE_CACHE_DISABLE 0x010
+#define PAGE_LARGE 0x080             // Directory entry maps a 4 MiB page
+#define PAGE_GLOBAL 0x100            // TLB entry survives CR3 reloads
+#define PAGE_FLAGS_MASK 0xFFF
+
+// Page table entries select their memory type from the PAT with the PAT, cache
+// disable and write through bits. paging_enable_write_combining turns PAT entry 4,
+// the one selected by the PAT bit alone, into write-combining.
+#define PAGE_PAT 0x080               // Same bit as PAGE_LARGE, which only directory entries have
+#define PAGE_WRITE_COMBINING PAGE_PAT
+
+// Kernel virtual memory above the direct map is mapped with 4 KiB pages
+// and page tables allocated on demand
+#define PAGING_KERNEL_VM_START (KERNEL_VIRTUAL_BASE + KERNEL_DIRECT_MAP_SIZE)
+#define PAGING_KERNEL_VM_END 0xFFC00000
+
+// Finish the switch to the higher half: drop the identity mapping of the
+// first 4 MiB that boot.asm needed to enable paging
+void paging_init();
+
+// Program the PAT so PAGE_WRITE_COMBINING can be used. Returns false if the CPU
+// has no PAT, PAGE_WRITE_COMBINING must not be used then.
+bool paging_enable_write_combining();
+
+// Map one 4 KiB page. Fails if the address lies in a 4 MiB page or a page
+// table can't be allocated. flags are PAGE_* values, PAGE_PRESENT is implied.
+bool paging_map_page(u32 virtual_address, u32 physical_address, u32 flags);
+
+// Get the page table entry of a 4 KiB page, 0 if the address lies in a 4 MiB
+// page or has no page table. With create, a missing page table is allocated.
+// Not present entries are ignored by the CPU, vm.c keeps its own state in them.
+u32* paging_get_entry(u32 virtual_address, bool create);
+
+// Remove the mapping of one 4 KiB page, returns the physical address it mapped or 0
+u32 paging_unmap_page(u32 virtual_address);
+
+// Translate a virtual address, returns 0 if it isn't mapped
+u32 paging_get_physical(u32 virtual_address);
+
+#endif
@@ -0,0 +1,229 @@
+#include "memory/pmm.h"
+
+#define PMM_LOW_MEMORY_END 0x100000 // BIOS data, VGA memory and ROMs live below 1 MiB
+#define PMM_FULL_WORD 0xFFFFFFFF
+
+// First (virtual) address after the kernel image, defined in link.ld
+extern u8 end[];
+
+static pmm_t pmm;
+
+// Helper function to check whether frame is used
+static bool is_frame_used(u32 frame) {
+    return (pmm.bitmap[frame / 32] & (1u << (frame % 32))) != 0;
+}
+
+// Helper function to mark frames [first, first + count) as used
+static void mark_frames_used(u32 first, u32 count) {
+    for (u32 frame = first; frame < first + count && frame < pmm.frame_count; frame++) {
+        if (!is_frame_used(frame)) {
+            pmm.bitmap[frame / 32] |= (1u << (frame % 32));
+            pmm.free_frames--;
+        }
+    }
+}
+
+// Helper function to mark frames [first, first + count) as free
+static void mark_frames_free(u32 first, u32 count) {
+    if (count == 0) {
+        return;
+    }
+    for (u32 frame = first; frame < first + count && frame < pmm.frame_count; frame++) {
+        if (is_frame_used(frame)) {
+            pmm.bitmap[frame / 32] &= ~(1u << (frame % 32));
+            pmm.free_frames++;
+        }
+    }
+    u32 last_word = (first + count - 1) / 32;
+    if (last_word >= pmm.bitmap_words) {
+        last_word = pmm.bitmap_words - 1;
+    }
+    if (last_word > pmm.search_hint) {
+        pmm.search_hint = last_word;
+    }
+}
+
+// Helper function to clip a 64-bit memory map region to the direct map,
+// frames outside it could not be reached by the kernel.
+// Returns false if nothing of it is addressable.
+static bool clip_region(multiboot_mmap_entry_t* entry, u32* base, u32* region_end) {
+    if (entry->base_high != 0) {
+        return false;
+    }
+    *base = entry->base_low;
+    *region_end = entry->base_low + entry->length_low;
+    if (entry->length_high != 0 || *region_end < *base || *region_end > KERNEL_DIRECT_MAP_SIZE) {
+        *region_end = KERNEL_DIRECT_MAP_SIZE;
+    }
+    return *region_end > *base;
+}
+
+// Helper function to call region() for every usable RAM region the bootloader reported
+static void for_each_usable_region(multiboot_info_t* multiboot_info, void (*region)(u32 base, u32 region_end)) {
+    if (multiboot_info->flags & MULTIBOOT_INFO_MEM_MAP) {
+        u32 entry_addr = PHYS_TO_VIRT(multiboot_info->mmap_addr);
+        u32 map_end = entry_addr + multiboot_info->mmap_length;
+
+        while (entry_addr < map_end) {
+            multiboot_mmap_entry_t* entry = (multiboot_mmap_entry_t*)entry_addr;
+            u32 base, region_end;
+            if (entry->type == MULTIBOOT_MEMORY_AVAILABLE && clip_region(entry, &base, &region_end)) {
+                region(base, region_end);
+            }
+            entry_addr += entry->size + sizeof(entry->size);
+        }
+    } else if (multiboot_info->flags & MULTIBOOT_INFO_MEMORY) {
+        // No memory map: only the contiguous block above 1 MiB is known
+        u32 region_end = PMM_LOW_MEMORY_END + multiboot_info->mem_upper * 1024;
+        region(PMM_LOW_MEMORY_END, region_end < KERNEL_DIRECT_MAP_SIZE ? region_end : KERNEL_DIRECT_MAP_SIZE);
+    }
+}
+
+// Region callback: grows the bitmap coverage to the highest usable address
+static void account_region_end(__attribute__((unused)) u32 base, u32 region_end) {
+    u32 frames = region_end / PMM_FRAME_SIZE;
+    if (frames > pmm.frame_count) {
+        pmm.frame_count = frames;
+    }
+}
+
+// Region callback: releases whole frames inside a usable region
+static void release_region(u32 base, u32 region_end) {
+    u32 first = (base + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    u32 last = region_end / PMM_FRAME_SIZE;
+    if (last > first) {
+        mark_frames_free(first, last - first);
+    }
+}
+
+void pmm_init(multiboot_info_t* multiboot_info) {
+    pmm.frame_count = 0;
+    pmm.free_frames = 0;
+    pmm.search_hint = 0;
+    pmm.bitmap_words = 0;
+    for_each_usable_region(multiboot_info, account_region_end);
+
+    // Bitmap goes to the first frame boundary after the kernel image, but must
+    // not overwrite the boot information in case the bootloader put it there.
+    // All addresses here are physical.
+    u32 bitmap_addr = VIRT_TO_PHYS(end);
+    u32 info_end = VIRT_TO_PHYS(multiboot_info) + sizeof(multiboot_info_t);
+    if (info_end > bitmap_addr) {
+        bitmap_addr = info_end;
+    }
+    if ((multiboot_info->flags & MULTIBOOT_INFO_MEM_MAP) &&
+        multiboot_info->mmap_addr + multiboot_info->mmap_length > bitmap_addr) {
+        bitmap_addr = multiboot_info->mmap_addr + multiboot_info->mmap_length;
+    }
+    bitmap_addr = (bitmap_addr + PMM_FRAME_SIZE - 1) & ~(PMM_FRAME_SIZE - 1);
+    pmm.bitmap = (u32*)PHYS_TO_VIRT(bitmap_addr);
+    pmm.bitmap_words = (pmm.frame_count + 31) / 32;
+
+    // Everything is used until the memory map proves otherwise
+    for (u32 i = 0; i < pmm.bitmap_words; i++) {
+        pmm.bitmap[i] = PMM_FULL_WORD;
+    }
+    for_each_usable_region(multiboot_info, release_region);
+    pmm.total_frames = pmm.free_frames;
+
+    // Reserve low memory, the kernel image and the bitmap itself
+    u32 reserved_end = bitmap_addr + pmm.bitmap_words * sizeof(u32);
+    mark_frames_used(0, (reserved_end + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE);
+    pmm.search_hint = pmm.bitmap_words - 1;
+}
+
+u32 pmm_alloc_frame() {
+    // Highest free frame first, low memory stays contiguous for the heap
+    for (u32 i = pmm.search_hint + 1; i > 0; i--) {
+        u32 word = pmm.bitmap[i - 1];
+        if (word != PMM_FULL_WORD) {
+            u32 frame = (i - 1) * 32 + 31 - __builtin_clz(~word);
+            pmm.search_hint = i - 1;
+            mark_frames_used(frame, 1);
+            return frame * PMM_FRAME_SIZE;
+        }
+    }
+    pmm.search_hint = 0;
+    return 0;
+}
+
+u32 pmm_alloc_frames(u32 count) {
+    if (count == 0) {
+        return 0;
+    }
+    if (count == 1) {
+        return pmm_alloc_frame();
+    }
+
+    // Same top-down search as for single frames, tracking a run of free frames
+    u32 run_length = 0;
+    u32 frame = (pmm.search_hint + 1) * 32;
+    while (frame > 0) {
+        frame--;
+
+        // Skip fully used words in one step
+        if (frame % 32 == 31 && pmm.bitmap[frame / 32] == PMM_FULL_WORD) {
+            run_length = 0;
+            frame -= 31;
+            continue;
+        }
+
+        if (frame >= pmm.frame_count || is_frame_used(frame)) {
+            run_length = 0;
+        } else if (++run_length == count) {
+            mark_frames_used(frame, count);
+            return frame * PMM_FRAME_SIZE;
+        }
+    }
+    return 0;
+}
+
+u32 pmm_alloc_frames_low(u32 count) {
+    u32 run_start = 0;
+    u32 run_length = 0;
+    for (u32 frame = 0; frame < pmm.frame_count && count > 0; frame++) {
+        if (is_frame_used(frame)) {
+            run_length = 0;
+            continue;
+        }
+        if (run_length == 0) {
+            run_start = frame;
+        }
+        if (++run_length == count) {
+            mark_frames_used(run_start, count);
+            return run_start * PMM_FRAME_SIZE;
+        }
+    }
+    return 0;
+}
+
+bool pmm_claim_frames(u32 address, u32 count) {
+    u32 first = address / PMM_FRAME_SIZE;
+    if (address % PMM_FRAME_SIZE != 0 || first + count > pmm.frame_count || first + count < first) {
+        return false;
+    }
+    for (u32 frame = first; frame < first + count; frame++) {
+        if (is_frame_used(frame)) {
+            return false;
+        }
+    }
+    mark_frames_used(first, count);
+    return true;
+}
+
+void pmm_free_frame(u32 address) {
+    pmm_free_frames(address, 1);
+}
+
+void pmm_free_frames(u32 address, u32 count) {
+    u32 first = address / PMM_FRAME_SIZE;
+    if (address < PMM_LOW_MEMORY_END || first >= pmm.frame_count) {
+        return; // Never hand out low memory or frames we don't track
+    }
+    mark_frames_free(first, count);
+}
+
+void pmm_get_stats(u32* total_frames, u32* free_frames) {
+    if (total_frames) *total_frames = pmm.total_frames;
+    if (free_frames) *free_frames = pmm.free_frames;
+}
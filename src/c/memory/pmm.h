@@ -0,0 +1,48 @@
+#ifndef PMM_H
+#define PMM_H
+
+#include "kernel/kernel.h"
+#include "kernel/multiboot.h"
+
+#define PMM_FRAME_SIZE 4096
+
+// Physical memory manager structure.
+// One bit per 4 KiB frame, a set bit means the frame is used or not RAM.
+typedef struct {
+    u32* bitmap;                 // Frame bitmap, placed right after the kernel image (virtual address)
+    u32 bitmap_words;            // Number of u32 words in the bitmap
+    u32 frame_count;             // Number of frames covered by the bitmap
+    u32 total_frames;            // Number of usable RAM frames
+    u32 free_frames;             // Number of free frames
+    u32 search_hint;             // Highest bitmap word that may contain a free frame
+} pmm_t;
+
+// Initialize physical memory manager from the multiboot memory map.
+// Only RAM inside the direct map (KERNEL_DIRECT_MAP_SIZE) is managed, and all
+// addresses taken and returned are physical: use PHYS_TO_VIRT to access a frame.
+void pmm_init(multiboot_info_t* multiboot_info);
+
+// Allocate one frame, returns its physical address or 0 if out of memory.
+// Frames are handed out from the top of RAM down.
+u32 pmm_alloc_frame();
+
+// Allocate count physically contiguous frames, returns the first address or 0
+u32 pmm_alloc_frames(u32 count);
+
+// Allocate the lowest run of count contiguous frames, for regions that grow
+// upwards (the kernel heap) and so want free frames above them
+u32 pmm_alloc_frames_low(u32 count);
+
+// Take the given frames if all of them are free, used to grow a region in place
+bool pmm_claim_frames(u32 address, u32 count);
+
+// Free one frame
+void pmm_free_frame(u32 address);
+
+// Free count contiguous frames starting at address
+void pmm_free_frames(u32 address, u32 count);
+
+// Get frame statistics
+void pmm_get_stats(u32* total_frames, u32* free_frames);
+
+#endif
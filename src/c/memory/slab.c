@@ -0,0 +1,192 @@
+#include "memory/slab.h"
+#include "memory/memory.h"
+#include "drivers/vga/vga.h"
+#include "libk/string.h"
+#include "libk/printf.h"
+
+static kmem_cache_t kmem_caches[KMEM_MAX_CACHES];
+
+// Helper function to round value up to a power-of-two alignment
+static u32 align_up(u32 value, u32 align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+// Helper function to find the word in front of an object that holds its slab,
+// or its free chain link. It sits at the same offset for every cache, and
+// living outside the object it leaves constructed objects alone while free.
+static u32* object_word(void* object) {
+    return (u32*)object - 1;
+}
+
+// Helper function to push slab to the head of a list
+static void slab_list_push(kmem_slab_t** list, kmem_slab_t* slab) {
+    slab->prev = 0;
+    slab->next = *list;
+    if (*list) {
+        (*list)->prev = slab;
+    }
+    *list = slab;
+}
+
+// Helper function to unlink slab from a list
+static void slab_list_remove(kmem_slab_t** list, kmem_slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+// Helper function to get a new slab from the heap and construct its objects
+static kmem_slab_t* slab_create(kmem_cache_t* cache) {
+    kmem_slab_t* slab = (kmem_slab_t*)malloc_tagged(cache->slab_size);
+    if (!slab) {
+        return 0;
+    }
+
+    slab->next = 0;
+    slab->prev = 0;
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->objects = (u8*)align_up((u32)(slab + 1) + sizeof(u32), cache->align);
+    slab->free_objects = 0;
+
+    // Chain objects back to front so that allocation goes in address order
+    for (u32 i = cache->objects_per_slab; i > 0; i--) {
+        void* object = slab->objects + (i - 1) * cache->object_size;
+        if (cache->constructor) {
+            cache->constructor(object);
+        }
+        *object_word(object) = (u32)slab->free_objects | KMEM_OBJECT_FREE;
+        slab->free_objects = object;
+    }
+
+    cache->slab_count++;
+    return slab;
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, u32 object_size, u32 align, void (*constructor)(void* object)) {
+    kmem_cache_t* cache = 0;
+    for (u32 i = 0; i < KMEM_MAX_CACHES; i++) {
+        if (!kmem_caches[i].in_use) {
+            cache = &kmem_caches[i];
+            break;
+        }
+    }
+    if (!cache || object_size == 0) {
+        return 0;
+    }
+
+    if (align < sizeof(void*)) {
+        align = sizeof(void*);
+    }
+
+    strlcpy(cache->name, name, KMEM_CACHE_NAME_LENGTH);
+
+    cache->constructor = constructor;
+    cache->align = align;
+    cache->object_size = align_up(object_size + sizeof(u32), align);
+
+    // Room for the slab header and the first object's word, plus worst-case
+    // padding up to the first object
+    u32 header_size = sizeof(kmem_slab_t) + sizeof(u32) + align - 1;
+    cache->slab_size = KMEM_SLAB_SIZE;
+    if ((cache->slab_size - header_size) / cache->object_size < KMEM_MIN_OBJECTS_PER_SLAB) {
+        cache->slab_size = header_size + cache->object_size * KMEM_MIN_OBJECTS_PER_SLAB;
+    }
+    cache->objects_per_slab = (cache->slab_size - header_size) / cache->object_size;
+
+    cache->partial_slabs = 0;
+    cache->full_slabs = 0;
+    cache->empty_slab = 0;
+    cache->slab_count = 0;
+    cache->active_objects = 0;
+    cache->in_use = true;
+    return cache;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    kmem_slab_t* slab = cache->partial_slabs;
+
+    if (!slab) {
+        slab = cache->empty_slab;
+        if (slab) {
+            cache->empty_slab = 0;
+        } else {
+            slab = slab_create(cache);
+            if (!slab) {
+                return 0;
+            }
+        }
+        slab_list_push(&cache->partial_slabs, slab);
+    }
+
+    void* object = slab->free_objects;
+    u32* word = object_word(object);
+    slab->free_objects = (void*)(*word & ~KMEM_OBJECT_FREE);
+    *word = (u32)slab;
+    slab->in_use++;
+    cache->active_objects++;
+
+    if (slab->in_use == cache->objects_per_slab) {
+        slab_list_remove(&cache->partial_slabs, slab);
+        slab_list_push(&cache->full_slabs, slab);
+    }
+
+    return object;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* object) {
+    if (!object) {
+        return;
+    }
+
+    u32* word = object_word(object);
+    if (*word & KMEM_OBJECT_FREE) {
+        return; // Freed twice
+    }
+    kmem_slab_t* slab = (kmem_slab_t*)*word;
+    if (!slab || slab->cache != cache) {
+        return; // Not an object of this cache
+    }
+    if (slab->in_use == cache->objects_per_slab) {
+        slab_list_remove(&cache->full_slabs, slab);
+        slab_list_push(&cache->partial_slabs, slab);
+    }
+
+    *word = (u32)slab->free_objects | KMEM_OBJECT_FREE;
+    slab->free_objects = object;
+    slab->in_use--;
+    cache->active_objects--;
+
+    if (slab->in_use == 0) {
+        slab_list_remove(&cache->partial_slabs, slab);
+
+        // Keep one empty slab around so alloc/free pairs don't hit the heap
+        if (!cache->empty_slab) {
+            cache->empty_slab = slab;
+        } else {
+            free(slab);
+            cache->slab_count--;
+        }
+    }
+}
+
+void kmem_cache_print_info() {
+    vga_print_color("Cache           ObjSize  Active/Total  Slabs  SlabSize\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+
+    for (u32 i = 0; i < KMEM_MAX_CACHES; i++) {
+        kmem_cache_t* cache = &kmem_caches[i];
+        if (!cache->in_use) {
+            continue;
+        }
+
+        // Columns line up with the header
+        kprintf_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK, "%-*s", KMEM_CACHE_NAME_LENGTH, cache->name);
+        kprintf("%7u  %6u/%-5u  %5u  %8u\n", cache->object_size, cache->active_objects,
+                cache->slab_count * cache->objects_per_slab, cache->slab_count, cache->slab_size);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "kernel/kernel.h"
+
+#define KMEM_MAX_CACHES 8
+#define KMEM_CACHE_NAME_LENGTH 16
+#define KMEM_SLAB_SIZE 4096              // Preferred slab size
+#define KMEM_MIN_OBJECTS_PER_SLAB 4      // Slabs grow beyond KMEM_SLAB_SIZE to fit at least this many
+#define KMEM_CACHE_LINE_SIZE 64
+
+#define KMEM_OBJECT_FREE 0x1             // Set in the word in front of an object while it is free
+
+// Slab: a chunk of heap memory carved into equally sized objects. Every object
+// is preceded by a word of the cache: it points to the owning slab while the
+// object is allocated, and holds the next free object plus KMEM_OBJECT_FREE
+// while it is free.
+typedef struct kmem_slab {
+    struct kmem_slab* next;      // Next slab in the cache list
+    struct kmem_slab* prev;      // Previous slab in the cache list
+    struct kmem_cache* cache;    // Cache the slab belongs to
+    void* free_objects;          // Head of the free object chain
+    u8* objects;                 // First object in the slab
+    u32 in_use;                  // Number of allocated objects
+} kmem_slab_t;
+
+// Object cache: slabs of one object type
+typedef struct kmem_cache {
+    char name[KMEM_CACHE_NAME_LENGTH];
+    u32 object_size;             // Object stride (aligned size, including the word in front)
+    u32 align;                   // Object alignment
+    u32 objects_per_slab;        // Objects in every slab
+    u32 slab_size;               // Bytes requested from malloc per slab
+    void (*constructor)(void* object);
+    kmem_slab_t* partial_slabs;  // Slabs with both free and used objects
+    kmem_slab_t* full_slabs;     // Slabs without free objects
+    kmem_slab_t* empty_slab;     // At most one fully free slab kept for reuse
+    u32 slab_count;              // Number of slabs
+    u32 active_objects;          // Number of allocated objects
+    bool in_use;                 // Cache descriptor is taken
+} kmem_cache_t;
+
+// Create an object cache. align = 0 means word alignment, KMEM_CACHE_LINE_SIZE
+// keeps hot objects on separate cache lines. The optional constructor runs once
+// per object when its slab is created; freed objects must be returned in
+// constructed state. Returns 0 if no cache descriptor is left.
+kmem_cache_t* kmem_cache_create(const char* name, u32 object_size, u32 align, void (*constructor)(void* object));
+
+// Allocate an object from the cache, 0 if out of memory
+void* kmem_cache_alloc(kmem_cache_t* cache);
+
+// Return an object to the cache. Objects of other caches and objects that
+// are already free are ignored.
+void kmem_cache_free(kmem_cache_t* cache, void* object);
+
+// Print per-cache occupancy (for debugging)
+void kmem_cache_print_info();
+
+#endif
@@ -0,0 +1,189 @@
+#include "memory/vm.h"
+#include "memory/paging.h"
+#include "memory/pmm.h"
+#include "libk/mem.h"
+
+#define VM_PAGE_FAULT_PRESENT 0x1  // Error code bit: the page was present (protection violation)
+
+static vm_t vm;
+
+// Helper function to round a size up to whole pages
+static u32 page_round_up(u32 size) {
+    return (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+// Helper function to find the region containing the address, 0 if there is none
+static vm_region_t* find_region(u32 address) {
+    for (u32 i = 0; i < vm.region_count; i++) {
+        vm_region_t* region = &vm.regions[i];
+        if (address >= region->start && address - region->start < region->size) {
+            return region;
+        }
+    }
+    return 0;
+}
+
+// Helper function to check that [address, address + size) lies inside one region
+static vm_region_t* find_region_range(u32 address, u32 size) {
+    vm_region_t* region = find_region(address);
+    if (!region || size > region->size - (address - region->start)) {
+        return 0;
+    }
+    return region;
+}
+
+void vm_init() {
+    vm.region_count = 0;
+    vm.demand_faults = 0;
+    vm.failed_faults = 0;
+}
+
+u32 vm_reserve(u32 size) {
+    if (size == 0 || size > PAGING_KERNEL_VM_END - PAGING_KERNEL_VM_START || vm.region_count == VM_MAX_REGIONS) {
+        return 0;
+    }
+    size = page_round_up(size);
+
+    // First fit between the regions. The new region gets a guard page in front,
+    // and the one behind it keeps its own, so a gap must hold size + PAGE_SIZE.
+    // Every region starts at least a page into the range, so end can't wrap.
+    u32 start = PAGING_KERNEL_VM_START + PAGE_SIZE;
+    u32 index = 0;
+    while (index < vm.region_count) {
+        u32 end = vm.regions[index].start - PAGE_SIZE; // Guard page of the next region
+        if (start <= end && end - start >= size) {
+            break;
+        }
+        start = vm.regions[index].start + vm.regions[index].size + PAGE_SIZE;
+        index++;
+    }
+    if (start >= PAGING_KERNEL_VM_END || PAGING_KERNEL_VM_END - start < size) {
+        return 0;
+    }
+
+    for (u32 i = vm.region_count; i > index; i--) {
+        vm.regions[i] = vm.regions[i - 1];
+    }
+    vm.regions[index].start = start;
+    vm.regions[index].size = size;
+    vm.regions[index].committed_pages = 0;
+    vm.regions[index].resident_pages = 0;
+    vm.regions[index].is_device = false;
+    vm.region_count++;
+    return start;
+}
+
+bool vm_commit(u32 address, u32 size) {
+    u32 first = address & ~(PAGE_SIZE - 1);
+    u32 last = page_round_up(address + size);
+    vm_region_t* region = find_region_range(first, last - first);
+    if (!region || size == 0) {
+        return false;
+    }
+
+    for (u32 page = first; page < last; page += PAGE_SIZE) {
+        u32* entry = paging_get_entry(page, true);
+        if (!entry) {
+            return false; // Pages committed so far stay committed
+        }
+        if (*entry == 0) {
+            *entry = VM_PAGE_COMMITTED;
+            region->committed_pages++;
+        }
+    }
+    return true;
+}
+
+void vm_decommit(u32 address, u32 size) {
+    u32 first = address & ~(PAGE_SIZE - 1);
+    u32 last = page_round_up(address + size);
+    vm_region_t* region = find_region_range(first, last - first);
+    if (!region) {
+        return;
+    }
+
+    for (u32 page = first; page < last; page += PAGE_SIZE) {
+        u32* entry = paging_get_entry(page, false);
+        if (!entry || *entry == 0) {
+            continue;
+        }
+        if (*entry & PAGE_PRESENT) {
+            u32 frame = paging_unmap_page(page);
+            if (!region->is_device) {
+                pmm_free_frame(frame);
+            }
+            region->resident_pages--;
+        } else {
+            *entry = 0;
+        }
+        region->committed_pages--;
+    }
+}
+
+u32 vm_map_physical(u32 physical_address, u32 size, u32 flags) {
+    u32 offset = physical_address & (PAGE_SIZE - 1);
+    u32 start = vm_reserve(offset + size);
+    if (start == 0) {
+        return 0;
+    }
+    vm_region_t* region = find_region(start);
+    region->is_device = true;
+
+    for (u32 page = 0; page < region->size; page += PAGE_SIZE) {
+        if (!paging_map_page(start + page, physical_address - offset + page, flags)) {
+            vm_release(start);
+            return 0;
+        }
+        region->committed_pages++;
+        region->resident_pages++;
+    }
+    return start + offset;
+}
+
+void vm_release(u32 address) {
+    vm_region_t* region = find_region(address);
+    if (!region || region->start != address) {
+        return;
+    }
+    vm_decommit(region->start, region->size);
+
+    // Page tables stay allocated, the next region in this range reuses them
+    u32 index = region - vm.regions;
+    vm.region_count--;
+    for (u32 i = index; i < vm.region_count; i++) {
+        vm.regions[i] = vm.regions[i + 1];
+    }
+}
+
+bool vm_handle_page_fault(u32 address, u32 error) {
+    if (error & VM_PAGE_FAULT_PRESENT) {
+        return false;
+    }
+    vm_region_t* region = find_region(address);
+    if (!region) {
+        return false;
+    }
+    u32 page = address & ~(PAGE_SIZE - 1);
+    u32* entry = paging_get_entry(page, false);
+    if (!entry || *entry != VM_PAGE_COMMITTED) {
+        return false;
+    }
+
+    u32 frame = pmm_alloc_frame();
+    if (frame == 0) {
+        vm.failed_faults++;
+        return false;
+    }
+
+    // Zero the frame through the direct map before it becomes visible
+    memset((void*)PHYS_TO_VIRT(frame), 0, PAGE_SIZE);
+
+    paging_map_page(page, frame, PAGE_WRITABLE);
+    region->resident_pages++;
+    vm.demand_faults++;
+    return true;
+}
+
+const vm_t* vm_get_info() {
+    return &vm;
+}
@@ -0,0 +1,64 @@
+#ifndef VM_H
+#define VM_H
+
+#include "kernel/kernel.h"
+
+#define VM_MAX_REGIONS 32
+
+// Page table entry of a committed page that has no frame yet. The entry is not
+// present, so the CPU ignores it and the first access raises a page fault.
+#define VM_PAGE_COMMITTED 0x200
+
+// A reserved range of kernel virtual memory. Every region is preceded by an
+// unreserved guard page, so running off the front of one (e.g. a stack
+// growing down) faults instead of touching its neighbour.
+typedef struct {
+    u32 start;                   // First address, page aligned
+    u32 size;                    // Reserved bytes, multiple of PAGE_SIZE
+    u32 committed_pages;         // Pages that may be touched (backed or not)
+    u32 resident_pages;          // Committed pages that have a frame
+    bool is_device;              // Maps device memory from vm_map_physical, no frames are owned
+} vm_region_t;
+
+// Virtual memory manager state
+typedef struct {
+    vm_region_t regions[VM_MAX_REGIONS]; // Sorted by start address
+    u32 region_count;
+    u32 demand_faults;           // Page faults resolved by backing a committed page
+    u32 failed_faults;           // Faults on committed pages with no free frame left
+} vm_t;
+
+// Reset the region table, called once the frame allocator is up
+void vm_init();
+
+// Reserve size bytes (rounded up to pages) of kernel virtual memory between
+// PAGING_KERNEL_VM_START and PAGING_KERNEL_VM_END. Nothing is mapped yet.
+// Returns the start address or 0 if no gap is large enough.
+u32 vm_reserve(u32 size);
+
+// Commit the pages of [address, address + size) inside a reserved region. They
+// cost no frame until first touched, then read as zero. Only page tables are
+// allocated here, which fails when there is no frame for one.
+bool vm_commit(u32 address, u32 size);
+
+// Give back the frames of [address, address + size) and uncommit its pages,
+// touching them afterwards is a fatal page fault again
+void vm_decommit(u32 address, u32 size);
+
+// Map size bytes of device memory (e.g. a framebuffer) starting at physical_address
+// into a new region, with flags being PAGE_* values such as PAGE_WRITE_COMBINING.
+// Returns the virtual address of physical_address or 0 on failure.
+u32 vm_map_physical(u32 physical_address, u32 size, u32 flags);
+
+// Decommit a whole region and release its address range, address is the start of the region
+void vm_release(u32 address);
+
+// Called for page faults (vector 14) with the faulting address from CR2.
+// Backs a committed page with a zeroed frame and returns true, so the faulting
+// instruction can be restarted. Returns false for any other fault.
+bool vm_handle_page_fault(u32 address, u32 error);
+
+// Get the region table and fault counters
+const vm_t* vm_get_info();
+
+#endif
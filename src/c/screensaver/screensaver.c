@@ -1,16 +1,39 @@
 #include "screensaver/screensaver.h"
 #include "drivers/keyboard/keyboard.h"
 #include "shell/shell.h"
+#include "libk/printf.h"
+#include "drivers/timer/timer.h"
 
 static screensaver_state_t screensaver_state;
-static u32 inactivity_timer = 0;
-static const u32 INACTIVITY_TIMEOUT = 350; // 7 seconds (350 timer ticks at ~20ms each)
+static ktimer_t inactivity_timer;
+static ktimer_t frame_timer;
+static ktimer_t spawn_timer;
+static ktimer_t laser_timer;
+static const u32 INACTIVITY_TIMEOUT_MS = 7000; // 7 seconds without a key press
+static const u32 FRAME_MS = 60;                // One animation frame, whatever the timer frequency
+static const u32 SPAWN_MS = 300;               // A new asteroid
+static const u32 LASER_MS = 480;               // A new laser shot
+
+static void screensaver_frame_expired(ktimer_t* timer);
+static void screensaver_spawn_expired(ktimer_t* timer);
+static void screensaver_laser_expired(ktimer_t* timer);
+static void screensaver_inactivity_expired(ktimer_t* timer);
+
+// Helper function to (re)start the countdown to the screensaver
+static void screensaver_arm_inactivity() {
+    timer_arm(&inactivity_timer, clock_monotonic_ns() + (u64)INACTIVITY_TIMEOUT_MS * TIMER_NS_PER_MS);
+}
 
 void screensaver_init() {
     screensaver_state.is_active = false;
     screensaver_state.type = SCREENSAVER_SPACE_BATTLE;
     screensaver_state.animation_frame = 0;
-    screensaver_state.last_timer_tick = 0;
+    // Deferred, the screensaver draws and its state is shared with the keyboard handling in the main loop
+    timer_init_deferred(&inactivity_timer, "screensaver idle", screensaver_inactivity_expired);
+    timer_init_deferred(&frame_timer, "screensaver frame", screensaver_frame_expired);
+    timer_init_deferred(&spawn_timer, "screensaver spawn", screensaver_spawn_expired);
+    timer_init_deferred(&laser_timer, "screensaver laser", screensaver_laser_expired);
+    screensaver_arm_inactivity();
     
     // Initialize space battle
     screensaver_state.spaceship_x = 40;
@@ -59,7 +82,10 @@ void screensaver_start(screensaver_type_t type) {
     screensaver_state.is_active = true;
     screensaver_state.type = type;
     screensaver_state.animation_frame = 0;
-    screensaver_state.last_timer_tick = 0;
+    timer_cancel(&inactivity_timer);
+    timer_arm_periodic(&frame_timer, (u64)FRAME_MS * TIMER_NS_PER_MS);
+    timer_arm_periodic(&spawn_timer, (u64)SPAWN_MS * TIMER_NS_PER_MS);
+    timer_arm_periodic(&laser_timer, (u64)LASER_MS * TIMER_NS_PER_MS);
     
     // Reset space battle
     screensaver_state.spaceship_x = 40;
@@ -91,21 +117,52 @@ void screensaver_start(screensaver_type_t type) {
 
 void screensaver_stop() {
     screensaver_state.is_active = false;
+    timer_cancel(&frame_timer);
+    timer_cancel(&spawn_timer);
+    timer_cancel(&laser_timer);
+    screensaver_arm_inactivity(); // The key press that stopped it counts as activity
     vga_clear();
 }
 
-void screensaver_timer_tick() {
-    if (!screensaver_state.is_active) {
+// Helper function to spawn an asteroid, the spawn timer expires every SPAWN_MS while active
+static void screensaver_spawn_expired(__attribute__((unused)) ktimer_t* timer) {
+    if (screensaver_state.game_over) {
         return;
     }
     
-    screensaver_state.animation_frame++;
-    
-    // Update animation every 3 timer ticks (faster animation)
-    if (screensaver_state.animation_frame % 3 != 0) {
+    for (u8 i = 0; i < 15; i++) {
+        if (!screensaver_state.asteroid_active[i]) {
+            screensaver_state.asteroid_x[i] = 5 + (screensaver_state.animation_frame % 70);
+            screensaver_state.asteroid_y[i] = 2;
+            screensaver_state.asteroid_type[i] = (screensaver_state.animation_frame + i) % 3;
+            screensaver_state.asteroid_speed[i] = 1 + (screensaver_state.animation_frame % 3);
+            screensaver_state.asteroid_active[i] = true;
+            break;
+        }
+    }
+}
+
+// Helper function to auto-shoot a laser, the laser timer expires every LASER_MS while active
+static void screensaver_laser_expired(__attribute__((unused)) ktimer_t* timer) {
+    if (screensaver_state.game_over) {
         return;
     }
     
+    for (u8 i = 0; i < 10; i++) {
+        if (!screensaver_state.laser_active[i]) {
+            screensaver_state.laser_x[i] = screensaver_state.spaceship_x;
+            screensaver_state.laser_y[i] = screensaver_state.spaceship_y - 1;
+            screensaver_state.laser_frame[i] = 0;
+            screensaver_state.laser_active[i] = true;
+            break;
+        }
+    }
+}
+
+// Helper function to advance the animation by a frame, the frame timer expires every FRAME_MS while active
+static void screensaver_frame_expired(__attribute__((unused)) ktimer_t* timer) {
+    screensaver_state.animation_frame++;
+    
     switch (screensaver_state.type) {
         case SCREENSAVER_SPACE_BATTLE:
             // Don't update animation if game is over
@@ -126,20 +183,6 @@ void screensaver_timer_tick() {
                 }
             }
             
-            // Spawn asteroids
-            if (screensaver_state.animation_frame % 15 == 0) {
-                for (u8 i = 0; i < 15; i++) {
-                    if (!screensaver_state.asteroid_active[i]) {
-                        screensaver_state.asteroid_x[i] = 5 + (screensaver_state.animation_frame % 70);
-                        screensaver_state.asteroid_y[i] = 2;
-                        screensaver_state.asteroid_type[i] = (screensaver_state.animation_frame + i) % 3;
-                        screensaver_state.asteroid_speed[i] = 1 + (screensaver_state.animation_frame % 3);
-                        screensaver_state.asteroid_active[i] = true;
-                        break;
-                    }
-                }
-            }
-            
             // Update asteroids
             for (u8 i = 0; i < 15; i++) {
                 if (screensaver_state.asteroid_active[i]) {
@@ -182,19 +225,6 @@ void screensaver_timer_tick() {
                 }
             }
             
-            // Auto-shoot lasers
-            if (screensaver_state.animation_frame % 8 == 0) {
-                for (u8 i = 0; i < 10; i++) {
-                    if (!screensaver_state.laser_active[i]) {
-                        screensaver_state.laser_x[i] = screensaver_state.spaceship_x;
-                        screensaver_state.laser_y[i] = screensaver_state.spaceship_y - 1;
-                        screensaver_state.laser_frame[i] = 0;
-                        screensaver_state.laser_active[i] = true;
-                        break;
-                    }
-                }
-            }
-            
             // Update lasers
             for (u8 i = 0; i < 10; i++) {
                 if (screensaver_state.laser_active[i]) {
@@ -279,6 +309,7 @@ void screensaver_draw() {
         return;
     }
     
+    vga_begin_update(); // One cursor update for the whole frame
     vga_clear();
     
     switch (screensaver_state.type) {
@@ -377,26 +408,7 @@ void screensaver_draw() {
             vga_set_cursor(0, 1);
             vga_print_color("Score: ", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
             
-            // Simple score display - just show the number directly
-            if (screensaver_state.score == 0) {
-                vga_print_color("0", VGA_COLOR_LIGHT_BROWN, VGA_COLOR_BLACK);
-            } else {
-                // Convert score to string manually
-                u32 temp_score = screensaver_state.score;
-                char score_digits[10];
-                u8 digit_count = 0;
-                
-                while (temp_score > 0 && digit_count < 9) {
-                    score_digits[digit_count] = '0' + (temp_score % 10);
-                    temp_score /= 10;
-                    digit_count++;
-                }
-                
-                // Print digits in reverse order
-                for (u8 i = digit_count; i > 0; i--) {
-                    vga_print_color(&score_digits[i-1], VGA_COLOR_LIGHT_BROWN, VGA_COLOR_BLACK);
-                }
-            }
+            kprintf_color(VGA_COLOR_LIGHT_BROWN, VGA_COLOR_BLACK, "%u", screensaver_state.score);
             
             vga_set_cursor(0, 2);
             vga_print_color("Lives: ", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
@@ -418,6 +430,7 @@ void screensaver_draw() {
         default:
             break;
     }
+    vga_end_update();
 }
 
 bool screensaver_is_active() {
@@ -428,21 +441,17 @@ screensaver_state_t* screensaver_get_state() {
     return &screensaver_state;
 }
 
-void screensaver_check_inactivity() {
+// Helper function to auto-start the space battle, the inactivity timer expires after INACTIVITY_TIMEOUT_MS without a key press
+static void screensaver_inactivity_expired(__attribute__((unused)) ktimer_t* timer) {
     if (screensaver_state.is_active) {
         return; // Screensaver already active
     }
     
-    inactivity_timer++;
-    
-    if (inactivity_timer >= INACTIVITY_TIMEOUT) {
-        screensaver_start(SCREENSAVER_SPACE_BATTLE); // Auto-start space battle screensaver
-        inactivity_timer = 0;
-    }
+    screensaver_start(SCREENSAVER_SPACE_BATTLE);
 }
 
 void screensaver_reset_timer() {
     if (!screensaver_state.is_active) {
-        inactivity_timer = 0;
+        screensaver_arm_inactivity();
     }
 }
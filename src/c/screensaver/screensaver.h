@@ -17,8 +17,7 @@ typedef enum {
 typedef struct {
     bool is_active;
     screensaver_type_t type;
-    u32 animation_frame;
-    u32 last_timer_tick;
+    u32 animation_frame;      // Animation frames since the start
     
     // Space battle data
     u16 spaceship_x, spaceship_y;
@@ -63,9 +62,6 @@ void screensaver_start(screensaver_type_t type);
 // Stop screensaver
 void screensaver_stop();
 
-// Handle timer tick for animation
-void screensaver_timer_tick();
-
 // Handle keyboard input
 void screensaver_handle_keyboard(struct keyboard_event event);
 
@@ -75,10 +71,7 @@ void screensaver_draw();
 // Check if screensaver is active
 bool screensaver_is_active();
 
-// Check for inactivity and auto-start screensaver
-void screensaver_check_inactivity();
-
-// Reset inactivity timer
+// Reset inactivity timer, the screensaver starts on its own once it expires
 void screensaver_reset_timer();
 
 // Get screensaver state
@@ -3,8 +3,25 @@
 #include "drivers/vga/vga.h"
 #include "filesystem/filesystem.h"
 #include "editor/editor.h"
+#include "memory/slab.h"
+#include "memory/memory.h"
+#include "memory/pmm.h"
+#include "memory/paging.h"
+#include "memory/vm.h"
+#include "libk/string.h"
+#include "libk/printf.h"
+#include "kernel/work_queue.h"
+#include "drivers/timer/timer.h"
 // command_editor removed — no include
 
+#define VGA_BENCHMARK_ROUNDS 100
+#define TIMERS_MAX_LISTED 16
+#define IRQSTAT_DURATION_SIZE 12
+#define IRQBENCH_ROUNDS 10000
+#define TSC_DRIFT_DEFAULT_SECONDS 3
+#define TSC_DRIFT_MAX_SECONDS 60
+#define TSC_DRIFT_TOLERANCE_PPB 100000 // 100 ppm, about what a 50 ms calibration can promise
+
 
 void cmd_help(const char* args) {
     // Print header and commands with minimal spacing so they appear closer together
@@ -17,6 +34,18 @@ void cmd_help(const char* args) {
     vga_print_color("list - List all files in system\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
     vga_print_color("read <name> - Read a file's content\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
     vga_print_color("delete <name> - Delete a file\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print_color("slabinfo - Show object cache usage\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print_color("meminfo - Show heap and physical memory usage\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print_color("memstat [serial] - Show allocation profile\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print_color("defrag - Compact the kernel heap\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print_color("vminfo - Show reserved virtual memory regions\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print_color("vgabench - Time full-screen redraws\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print_color("uptime - Show time since boot\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print_color("timers - Show armed timers and their callback times\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print_color("workstat - Show deferred interrupt work\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print_color("irqstat [serial|reset] - Show interrupt counts and times\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print_color("irqbench - Time interrupt entry and exit\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print_color("tscdrift [seconds] - Check the TSC against the PIT\n", VGA_COLOR_WHITE, VGA_COLOR_BLACK);
     vga_newline();
 }
 
@@ -140,7 +169,11 @@ void cmd_read(const char* args) {
         return;
     }
     
-    char buffer[MAX_FILE_SIZE];
+    char* buffer = arena_alloc(shell_get_arena(), MAX_FILE_SIZE);
+    if (!buffer) {
+        vga_print_color("Out of memory\n", VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+        return;
+    }
     if (fs_read_file(args, buffer, MAX_FILE_SIZE)) {
         vga_print_color("Content of '", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
         vga_print(args);
@@ -162,7 +195,11 @@ void cmd_view(const char* args) {
         return;
     }
     
-    char buffer[MAX_FILE_SIZE];
+    char* buffer = arena_alloc(shell_get_arena(), MAX_FILE_SIZE);
+    if (!buffer) {
+        vga_print_color("Out of memory\n", VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+        return;
+    }
     if (fs_read_file(args, buffer, MAX_FILE_SIZE)) {
         vga_print_color("Content of '", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
         vga_print(args);
@@ -193,28 +230,7 @@ void cmd_size(const char* args) {
     vga_print_color("File '", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
     vga_print(args);
     vga_print_color("' size: ", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
-    
-    char size_str[8];
-    u16 pos = 0;
-    if (size == 0) {
-        size_str[pos++] = '0';
-    } else {
-        u16 temp = size;
-        while (temp > 0) {
-            size_str[pos++] = '0' + (temp % 10);
-            temp /= 10;
-        }
-    }
-    size_str[pos] = '\0';
-    
-    // Reverse the string
-    for (u16 i = 0; i < pos / 2; i++) {
-        char temp = size_str[i];
-        size_str[i] = size_str[pos - 1 - i];
-        size_str[pos - 1 - i] = temp;
-    }
-    
-    vga_print(size_str);
+    kprintf("%u", size);
     vga_print_color(" characters\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
 }
 
@@ -239,6 +255,262 @@ void cmd_clear_content(const char* args) {
 
 
 
+void cmd_slabinfo(__attribute__((unused)) const char* args) {
+    kmem_cache_print_info();
+}
+
+void cmd_meminfo(__attribute__((unused)) const char* args) {
+    u32 heap_total, heap_free, heap_used, heap_blocks;
+    memory_get_stats(&heap_total, &heap_free, &heap_used, &heap_blocks);
+
+    vga_print_color("Kernel heap\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+    kprintf("  Total: %u KiB\n"
+            "  Used:  %u KiB\n"
+            "  Free:  %u KiB\n"
+            "  Largest free block: %u KiB\n"
+            "  Blocks: %u  Fragmentation: %u%%\n",
+            heap_total / 1024, heap_used / 1024, heap_free / 1024, memory_get_largest_free_block() / 1024,
+            heap_blocks, memory_get_fragmentation());
+
+    u32 total_frames, free_frames;
+    pmm_get_stats(&total_frames, &free_frames);
+
+    vga_print_color("Physical memory\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+    kprintf("  Total: %u KiB\n"
+            "  Used:  %u KiB\n"
+            "  Free:  %u KiB\n",
+            total_frames * (PMM_FRAME_SIZE / 1024), (total_frames - free_frames) * (PMM_FRAME_SIZE / 1024),
+            free_frames * (PMM_FRAME_SIZE / 1024));
+}
+
+void cmd_memstat(const char* args) {
+    if (args && strcmp(args, "serial") == 0) {
+        memory_print_profile(true);
+        vga_print_color("Allocation profile written to serial\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+        return;
+    }
+    vga_print_color("Allocation profile\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+    memory_print_profile(false);
+}
+
+void cmd_defrag(__attribute__((unused)) const char* args) {
+    u32 largest_before = memory_get_largest_free_block();
+    u32 moved = memory_defragment();
+
+    kprintf("Moved %u blocks, largest free block %u KiB -> %u KiB\n", moved, largest_before / 1024,
+            memory_get_largest_free_block() / 1024);
+}
+
+void cmd_vminfo(__attribute__((unused)) const char* args) {
+    const vm_t* vm = vm_get_info();
+
+    vga_print_color("Virtual memory regions\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+    if (vm->region_count == 0) {
+        vga_print("  None reserved\n");
+    }
+    for (u32 i = 0; i < vm->region_count; i++) {
+        const vm_region_t* region = &vm->regions[i];
+        kprintf("  %#010x: reserved %u KiB, committed %u KiB, resident %u KiB\n", region->start,
+                region->size / 1024, region->committed_pages * (PAGE_SIZE / 1024),
+                region->resident_pages * (PAGE_SIZE / 1024));
+    }
+    kprintf("Demand-zero faults: %u  Out of frames: %u\n", vm->demand_faults, vm->failed_faults);
+}
+
+void cmd_vgabench(__attribute__((unused)) const char* args) {
+    u32 uncached_cycles, current_cycles;
+    if (tsc_get_khz() == 0 || !vga_benchmark_redraw(VGA_BENCHMARK_ROUNDS, &uncached_cycles, &current_cycles)) {
+        vga_print_color("No calibrated TSC\n", VGA_COLOR_RED, VGA_COLOR_BLACK);
+        return;
+    }
+
+    vga_print_color("Full-screen redraw, CPU cycles\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+    kprintf("  Uncached:        %u\n"
+            "  Framebuffer map: %u", uncached_cycles, current_cycles);
+    if (current_cycles > 0) {
+        kprintf(" (%ux faster)", uncached_cycles / current_cycles);
+    }
+    vga_newline();
+}
+
+void cmd_irqbench(__attribute__((unused)) const char* args) {
+    u32 legacy_cycles, lean_cycles;
+    if (tsc_get_khz() == 0 || !benchmark_interrupt_entry(IRQBENCH_ROUNDS, &legacy_cycles, &lean_cycles)) {
+        vga_print_color("No calibrated TSC\n", VGA_COLOR_RED, VGA_COLOR_BLACK);
+        return;
+    }
+
+    vga_print_color("Interrupt round trip to an empty handler, CPU cycles\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+    kprintf("  Legacy entry: %u\n"
+            "  Lean entry:   %u", legacy_cycles, lean_cycles);
+    if (lean_cycles > 0 && legacy_cycles > lean_cycles) {
+        kprintf(" (%u%% less)", (legacy_cycles - lean_cycles) * 100 / legacy_cycles);
+    }
+    vga_newline();
+}
+
+void cmd_uptime(__attribute__((unused)) const char* args) {
+    u32 nanoseconds;
+    u32 seconds = (u32)div_u64(clock_monotonic_ns(), 1000000000, &nanoseconds);
+
+    kprintf("Up %u:%02u:%02u.%03u\n", seconds / 3600, seconds / 60 % 60, seconds % 60, nanoseconds / 1000000);
+    if (timer_is_tickless()) {
+        kprintf("  Timer: %u interrupts, tickless, %u timers armed\n", (u32)timer_get_interrupts(), timer_get_armed());
+    } else {
+        kprintf("  Timer: %u ticks at %u Hz, %u timers armed\n", (u32)timer_get_interrupts(), timer_get_frequency(),
+                timer_get_armed());
+    }
+    u32 tsc_khz = tsc_get_khz();
+    if (tsc_khz > 0) {
+        kprintf("  TSC:   %u.%03u MHz%s\n", tsc_khz / 1000, tsc_khz % 1000, tsc_is_invariant() ? ", invariant" : "");
+    } else {
+        kprintf("  TSC:   not available, time advances in ticks\n");
+    }
+}
+
+void cmd_timers(__attribute__((unused)) const char* args) {
+    ktimer_t* timers = arena_alloc(shell_get_arena(), TIMERS_MAX_LISTED * sizeof(ktimer_t));
+    if (!timers) {
+        vga_print_color("Out of memory\n", VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK);
+        return;
+    }
+    u32 count = timer_get_stats(timers, TIMERS_MAX_LISTED);
+    u64 now = clock_monotonic_ns();
+
+    kprintf("%u timers armed\n", timer_get_armed());
+    if (count == 0) {
+        return;
+    }
+    vga_print_color("  Name                 Due ms  Period   Runs  Avg us  Max us\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+    for (u32 i = 0; i < count; i++) {
+        const ktimer_t* timer = &timers[i];
+        u32 due_ms = timer->deadline > now ? (u32)div_u64(timer->deadline - now, TIMER_NS_PER_MS, 0) : 0;
+        u32 period_ms = (u32)div_u64(timer->period, TIMER_NS_PER_MS, 0);
+        u32 average_us = timer->runs ? (u32)div_u64(div_u64(timer->total_ns, timer->runs, 0), 1000, 0) : 0;
+        kprintf("  %-19.19s %7u %7u %6u %7u %7u\n", timer->name ? timer->name : "?", due_ms, period_ms,
+                timer->runs, average_us, timer->max_ns / 1000);
+    }
+}
+
+void cmd_workstat(__attribute__((unused)) const char* args) {
+    work_queue_stats_t stats;
+    work_queue_get_stats(&stats);
+
+    vga_print_color("Deferred work\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+    kprintf("  Queued: %u  Dropped: %u  Most waiting: %u of %u\n", stats.queued, stats.dropped, stats.max_depth,
+            WORK_QUEUE_SIZE);
+    if (tsc_get_khz() == 0) {
+        return; // Times need the TSC
+    }
+    kprintf("  Longest wait: %u us  Longest run: %u us  Average run: %u us\n", stats.max_wait_ns / 1000,
+            stats.max_run_ns / 1000, stats.ran ? (u32)div_u64(stats.total_run_ns, stats.ran, 0) / 1000 : 0);
+}
+
+// Helper function to format a number of TSC cycles as a duration in a fitting unit
+static void format_cycles(char* buffer, u64 cycles) {
+    u64 ns = cycles_to_ns(cycles);
+    if (ns < 10000) {
+        ksnprintf(buffer, IRQSTAT_DURATION_SIZE, "%uns", (u32)ns);
+    } else if (ns < 10000000) {
+        ksnprintf(buffer, IRQSTAT_DURATION_SIZE, "%uus", (u32)ns / 1000);
+    } else {
+        ksnprintf(buffer, IRQSTAT_DURATION_SIZE, "%ums", (u32)div_u64(ns, 1000000, 0));
+    }
+}
+
+// Helper function to print the nonzero buckets of a histogram, labelled with their upper bounds
+static void print_histogram(u32 targets, const char* title, const u32* histogram) {
+    char bound[IRQSTAT_DURATION_SIZE];
+    kprintf_to(targets, VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK, "    %s:", title);
+    for (u32 i = 0; i < INTERRUPT_HISTOGRAM_BUCKETS; i++) {
+        if (histogram[i] == 0) {
+            continue;
+        }
+        if (i == INTERRUPT_HISTOGRAM_BUCKETS - 1) {
+            format_cycles(bound, (u64)1 << (INTERRUPT_HISTOGRAM_SHIFT + i - 1));
+            kprintf_to(targets, VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK, " >=%s:%u", bound, histogram[i]);
+        } else {
+            format_cycles(bound, (u64)1 << (INTERRUPT_HISTOGRAM_SHIFT + i));
+            kprintf_to(targets, VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK, " <%s:%u", bound, histogram[i]);
+        }
+    }
+    kprintf_to(targets, VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK, "\n");
+}
+
+void cmd_irqstat(const char* args) {
+    static const char* names[INTERRUPT_LINES] = {
+        "timer", "keyboard", "cascade", "com2", "com1", "lpt2", "floppy", "lpt1",
+        "rtc", "free", "free", "free", "mouse", "fpu", "ata1", "ata2"
+    };
+
+    if (args && strcmp(args, "reset") == 0) {
+        reset_interrupt_stats();
+        vga_print_color("Interrupt statistics reset\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+        return;
+    }
+    // The serial dump has the full histograms of both times, the screen only those of the handlers
+    bool serial = args && strcmp(args, "serial") == 0;
+    u32 targets = serial ? KPRINTF_SERIAL : KPRINTF_VGA;
+    bool timed = tsc_get_khz() != 0;
+
+    kprintf_to(targets, VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK, "IRQ Name         Count  Spurious Unclaimed   Avg time  Max time   Max EOI\n");
+    for (u32 line = 0; line < INTERRUPT_LINES; line++) {
+        interrupt_stats_t stats;
+        get_interrupt_stats(line, &stats);
+        if (stats.count == 0 && stats.spurious == 0) {
+            continue;
+        }
+
+        char average[IRQSTAT_DURATION_SIZE] = "-";
+        char longest[IRQSTAT_DURATION_SIZE] = "-";
+        char longest_eoi[IRQSTAT_DURATION_SIZE] = "-";
+        if (timed && stats.count > 0) {
+            format_cycles(average, div_u64(stats.handler_cycles, stats.count, 0));
+            format_cycles(longest, stats.max_handler_cycles);
+            format_cycles(longest_eoi, stats.max_eoi_cycles);
+        }
+        kprintf_to(targets, VGA_DEFAULT_FG, VGA_DEFAULT_BG, "%3u %-8s %9u %9u %9u %10s %9s %9s\n", line, names[line],
+                   stats.count, stats.spurious, stats.unclaimed, average, longest, longest_eoi);
+        if (timed && stats.count > 0) {
+            print_histogram(targets, "handler", stats.handler_histogram);
+            if (serial) {
+                print_histogram(targets, "to EOI", stats.eoi_histogram);
+            }
+        }
+    }
+    if (serial) {
+        vga_print_color("Interrupt statistics written to serial\n", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+    }
+}
+
+void cmd_tscdrift(const char* args) {
+    u32 seconds = TSC_DRIFT_DEFAULT_SECONDS;
+    if (args && *args && (!parse_u32(args, &seconds, 0) || seconds == 0 || seconds > TSC_DRIFT_MAX_SECONDS)) {
+        kprintf_color(VGA_COLOR_RED, VGA_COLOR_BLACK, "Usage: tscdrift [1-%u seconds]\n", TSC_DRIFT_MAX_SECONDS);
+        return;
+    }
+    if (tsc_get_khz() == 0) {
+        vga_print_color("No calibrated TSC\n", VGA_COLOR_RED, VGA_COLOR_BLACK);
+        return;
+    }
+
+    u32 tsc_khz = tsc_get_khz();
+    kprintf("TSC at %u.%03u MHz (%s), comparing with the PIT for %u s...\n", tsc_khz / 1000, tsc_khz % 1000,
+            tsc_is_invariant() ? "invariant" : "not invariant", seconds);
+    tsc_drift_t drift;
+    if (!tsc_measure_drift(seconds, &drift)) {
+        vga_print_color("The PIT did not count\n", VGA_COLOR_RED, VGA_COLOR_BLACK);
+        return;
+    }
+
+    u32 ppb = drift.drift_ppb < 0 ? 0u - (u32)drift.drift_ppb : (u32)drift.drift_ppb;
+    kprintf("  PIT:      %u us\n"
+            "  TSC:      %u us\n"
+            "  Measured: %u.%03u MHz\n", drift.pit_us, drift.tsc_us, drift.measured_khz / 1000, drift.measured_khz % 1000);
+    kprintf_color(ppb <= TSC_DRIFT_TOLERANCE_PPB ? VGA_COLOR_LIGHT_GREEN : VGA_COLOR_RED, VGA_COLOR_BLACK,
+                  "  Drift:    %c%u.%03u ppm\n", drift.drift_ppb < 0 ? '-' : '+', ppb / 1000, ppb % 1000);
+}
+
 void commands_init() {
     // Register only the commands requested by the user
     shell_register_command("help", cmd_help, "Show help message");
@@ -251,5 +523,19 @@ void commands_init() {
     shell_register_command("delete", cmd_delete, "Delete a file");
     shell_register_command("read", cmd_read, "Read file content");
     shell_register_command("edit", cmd_edit, "Edit an existing file");
+
+    // Diagnostics
+    shell_register_command("slabinfo", cmd_slabinfo, "Show object cache usage");
+    shell_register_command("meminfo", cmd_meminfo, "Show heap and physical memory usage");
+    shell_register_command("memstat", cmd_memstat, "Show allocation profile");
+    shell_register_command("defrag", cmd_defrag, "Compact the kernel heap");
+    shell_register_command("vminfo", cmd_vminfo, "Show reserved virtual memory regions");
+    shell_register_command("vgabench", cmd_vgabench, "Time full-screen redraws");
+    shell_register_command("uptime", cmd_uptime, "Show time since boot");
+    shell_register_command("timers", cmd_timers, "Show armed timers and their callback times");
+    shell_register_command("workstat", cmd_workstat, "Show deferred interrupt work");
+    shell_register_command("irqstat", cmd_irqstat, "Show interrupt counts and times");
+    shell_register_command("irqbench", cmd_irqbench, "Time interrupt entry and exit");
+    shell_register_command("tscdrift", cmd_tscdrift, "Check the TSC against the PIT");
     
 }
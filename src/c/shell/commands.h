@@ -23,6 +23,20 @@ void cmd_screensaver(const char* args);
 void cmd_size(const char* args);
 void cmd_clear_content(const char* args);
 
+// Diagnostics
+void cmd_slabinfo(const char* args);
+void cmd_meminfo(const char* args);
+void cmd_memstat(const char* args);
+void cmd_defrag(const char* args);
+void cmd_vminfo(const char* args);
+void cmd_vgabench(const char* args);
+void cmd_uptime(const char* args);
+void cmd_timers(const char* args);
+void cmd_workstat(const char* args);
+void cmd_irqstat(const char* args);
+void cmd_irqbench(const char* args);
+void cmd_tscdrift(const char* args);
+
 // Register all built-in commands
 void commands_init();
 
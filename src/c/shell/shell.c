@@ -3,31 +3,42 @@
 #include "drivers/vga/vga.h"
 #include "filesystem/filesystem.h"
 #include "screensaver/screensaver.h"
+#include "memory/slab.h"
+#include "memory/memory.h"
+#include "libk/string.h"
+#include "kernel/work_queue.h"
 
 static shell_state_t shell_state;
-static shell_command_t commands[16];
+static shell_command_t* commands[SHELL_MAX_COMMANDS];
 static u8 command_count = 0;
-
-static bool str_equals(const char* a, const char* b) {
-    while (*a && *b) {
-        if (*a != *b) return false;
-        a++; b++;
-    }
-    return *a == *b;
-}
+static kmem_cache_t* command_cache;
+static arena_t command_arena;
 
 /* History buffer and display removed. */
 
-static void str_copy(char* dest, const char* src) {
-    while (*src) *dest++ = *src++;
-    *dest = '\0';
+// Helper function to make room for a line of length characters and its
+// terminator. The buffer doubles when it fills up, so typing stays O(1)
+// per character however long the line gets.
+static bool reserve_input(u16 length) {
+    if (length < shell_state.input_capacity) return true;
+    u16 capacity = shell_state.input_capacity ? shell_state.input_capacity : SHELL_INPUT_INITIAL_SIZE;
+    while (capacity <= length) capacity *= 2;
+    if (capacity > SHELL_MAX_INPUT_LENGTH) capacity = SHELL_MAX_INPUT_LENGTH;
+    char* buffer = realloc(shell_state.input_buffer, capacity);
+    if (!buffer) return false;
+    shell_state.input_buffer = buffer; shell_state.input_capacity = capacity;
+    return true;
 }
 
 void shell_init() {
+    shell_state.input_buffer = 0;
+    shell_state.input_capacity = 0;
     shell_state.input_length = 0;
     shell_state.cursor_position = 0;
     shell_state.is_running = true;
     shell_state.just_exited_interactive = false;
+    command_cache = kmem_cache_create("shell_command", sizeof(shell_command_t), 0, 0);
+    arena_init_reserved(&command_arena, SHELL_ARENA_CHUNK_SIZE, SHELL_ARENA_RESERVE_SIZE);
     vga_init();
     fs_init();
     editor_init();
@@ -38,7 +49,10 @@ void shell_init() {
     shell_print_prompt();
 }
 
-void shell_run() { while (shell_state.is_running) halt(); }
+void shell_run() {
+    // Keyboard input and timers arrive as work items, run with interrupts enabled
+    while (shell_state.is_running) { work_queue_run(); work_queue_idle(); }
+}
 
 void shell_handle_keyboard(struct keyboard_event event) {
     screensaver_reset_timer();
@@ -61,7 +75,7 @@ void shell_handle_keyboard(struct keyboard_event event) {
         }
         return;
     }
-    if (c >= 32 && c <= 126 && shell_state.input_length < SHELL_MAX_INPUT_LENGTH - 1) {
+    if (c >= 32 && c <= 126 && shell_state.input_length < SHELL_MAX_INPUT_LENGTH - 1 && reserve_input(shell_state.input_length + 1)) {
         for (u16 i = shell_state.input_length; i > shell_state.cursor_position; i--) shell_state.input_buffer[i] = shell_state.input_buffer[i - 1];
         shell_state.input_buffer[shell_state.cursor_position] = c; shell_state.cursor_position++; shell_state.input_length++;
         shell_state.input_buffer[shell_state.input_length] = '\0'; vga_putchar(c);
@@ -71,28 +85,33 @@ void shell_handle_keyboard(struct keyboard_event event) {
 void shell_process_command() {
     if (shell_state.input_length == 0) return;
     (void)0; // history removed
-    char command_name[SHELL_MAX_COMMAND_LENGTH]; u16 i = 0, j = 0;
+    char* command_name = arena_alloc(&command_arena, SHELL_MAX_COMMAND_LENGTH); u16 i = 0, j = 0;
+    char* args = arena_alloc(&command_arena, shell_state.input_length + 1); // Never longer than the input
+    if (!command_name || !args) { shell_print_error("Out of memory\n"); arena_reset(&command_arena); return; }
     while (i < shell_state.input_length && shell_state.input_buffer[i] == ' ') i++;
     while (i < shell_state.input_length && shell_state.input_buffer[i] != ' ' && j < SHELL_MAX_COMMAND_LENGTH - 1) command_name[j++] = shell_state.input_buffer[i++];
     command_name[j] = '\0';
-    char args[SHELL_MAX_INPUT_LENGTH]; u16 args_start = i, args_len = 0;
+    u16 args_start = i, args_len = 0;
     while (args_start < shell_state.input_length && shell_state.input_buffer[args_start] == ' ') args_start++;
     while (args_start < shell_state.input_length && args_len < SHELL_MAX_INPUT_LENGTH - 1) args[args_len++] = shell_state.input_buffer[args_start++];
     args[args_len] = '\0';
     bool command_found = false;
     for (u8 k = 0; k < command_count; k++) {
-        if (str_equals(command_name, commands[k].name)) { commands[k].handler(args); command_found = true; break; }
+        if (strcmp(command_name, commands[k]->name) == 0) { commands[k]->handler(args); command_found = true; break; }
     }
     if (!command_found) { shell_print_error("Command not found: "); vga_print(command_name); vga_newline(); }
-    shell_state.input_length = 0; shell_state.cursor_position = 0; for (i = 0; i < SHELL_MAX_INPUT_LENGTH; i++) shell_state.input_buffer[i] = '\0';
+    arena_reset(&command_arena); // Drops the command's scratch memory along with name and args
+    shell_state.input_length = 0; shell_state.cursor_position = 0; for (i = 0; i < shell_state.input_capacity; i++) shell_state.input_buffer[i] = '\0';
 }
 
 void shell_register_command(const char* name, void (*handler)(const char* args), const char* description) {
-    if (command_count >= 16) return;
-    str_copy(commands[command_count].name, name);
-    commands[command_count].handler = handler;
-    str_copy(commands[command_count].description, description);
-    command_count++;
+    if (command_count >= SHELL_MAX_COMMANDS) return;
+    shell_command_t* command = kmem_cache_alloc(command_cache);
+    if (!command) return;
+    strlcpy(command->name, name, sizeof(command->name));
+    command->handler = handler;
+    strlcpy(command->description, description, sizeof(command->description));
+    commands[command_count++] = command;
 }
 
 void shell_print_prompt() { vga_print_color("shell> ", VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK); }
@@ -103,13 +122,12 @@ void shell_check_and_scroll() {
 }
 
 void shell_scroll_up() {
-    u16* framebuffer = (u16*)VGA_FRAMEBUFFER_ADDR;
-    for (u8 y = 0; y < VGA_HEIGHT - 1; y++) for (u16 x = 0; x < VGA_WIDTH; x++) framebuffer[y * VGA_WIDTH + x] = framebuffer[(y + 1) * VGA_WIDTH + x];
-    for (u16 x = 0; x < VGA_WIDTH; x++) { vga_set_cursor(x, VGA_HEIGHT - 1); vga_putchar_color(' ', VGA_COLOR_BLACK, VGA_COLOR_BLACK); }
+    vga_scroll(); // The driver keeps a copy of the screen, video memory is never read back
     vga_set_cursor(0, VGA_HEIGHT - 1);
 }
 
 void shell_print_error(const char* message) { vga_print_color(message, VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK); }
 void shell_print_info(const char* message) { vga_print_color(message, VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK); }
 shell_state_t* shell_get_state() { return &shell_state; }
+arena_t* shell_get_arena() { return &command_arena; }
 
@@ -6,15 +6,21 @@
 #include "drivers/keyboard/keyboard.h"
 #include "editor/editor.h"
 #include "screensaver/screensaver.h"
+#include "memory/arena.h"
 
 #define SHELL_MAX_INPUT_LENGTH 256
+#define SHELL_INPUT_INITIAL_SIZE 32   // The input buffer starts this small and doubles as a line gets longer
 #define SHELL_MAX_COMMAND_LENGTH 64
 #define SHELL_MAX_ARGS 16
+#define SHELL_MAX_COMMANDS 32
+#define SHELL_ARENA_CHUNK_SIZE 8192   // Scratch memory for one command that stays backed between commands
+#define SHELL_ARENA_RESERVE_SIZE 0x40000 // Scratch address space for one command, backed as it is touched
 
 
 // Shell state
 typedef struct {
-    char input_buffer[SHELL_MAX_INPUT_LENGTH];
+    char* input_buffer;           // Grown with realloc, up to SHELL_MAX_INPUT_LENGTH bytes
+    u16 input_capacity;
     u16 input_length;
     u16 cursor_position;
     bool is_running;
@@ -64,4 +70,8 @@ void shell_print_info(const char* message);
 // Get current shell state
 shell_state_t* shell_get_state();
 
+// Get the scratch arena of the running command. Everything allocated from it
+// is released when the command returns.
+arena_t* shell_get_arena();
+
 #endif